@@ -0,0 +1,436 @@
+#include <cassert>
+#include <cstring>
+#include "cpputil.h"
+#include "exceptions.h"
+#include "node.h"
+#include "outbuf.h"
+#include "ast_export.h"
+
+namespace {
+
+const char MAGIC[] = "NCCA";
+const unsigned MAGIC_LEN = 4;
+const unsigned FORMAT_VERSION = 1;
+
+// parent of the root node of a declaration
+const unsigned long NO_PARENT = ~0UL;
+
+struct RecordSchema {
+  ASTExportRecord rec;
+  const char *name;
+  std::vector<const char *> fields;
+};
+
+const RecordSchema SCHEMA[] = {
+  { AREC_END,            "end",            { } },
+  { AREC_SCHEMA,         "schema",         { "record", "name", "fields[name]" } },
+  { AREC_TAG,            "tag",            { "tag", "name" } },
+  { AREC_FILE,           "file",           { "name" } },
+  { AREC_BASIC_TYPE,     "basic_type",     { "kind", "signed" } },
+  { AREC_QUALIFIED_TYPE, "qualified_type", { "base", "qualifier" } },
+  { AREC_POINTER_TYPE,   "pointer_type",   { "base" } },
+  { AREC_ARRAY_TYPE,     "array_type",     { "base", "size" } },
+  { AREC_FUNCTION_TYPE,  "function_type",  { "base", "members[name,type]" } },
+  { AREC_STRUCT_TYPE,    "struct_type",    { "name" } },
+  { AREC_STRUCT_MEMBERS, "struct_members", { "struct", "members[name,type]" } },
+  { AREC_ERROR_TYPE,     "error_type",     { } },
+  { AREC_DECLARATION,    "declaration",    { } },
+  { AREC_NODE,           "node",           { "tag", "num_kids", "str", "file", "line", "col",
+                                             "type", "value_type" } },
+};
+
+const char *basic_type_kind_name(BasicTypeKind kind) {
+  switch (kind) {
+  case BasicTypeKind::CHAR:  return "char";
+  case BasicTypeKind::SHORT: return "short";
+  case BasicTypeKind::INT:   return "int";
+  case BasicTypeKind::LONG:  return "long";
+  case BasicTypeKind::VOID:  return "void";
+  default:                   return "nothing";
+  }
+}
+
+}
+
+ASTExporter::ASTExporter(const std::string &filename, ASTExportFormat format)
+  : m_filename(filename)
+  , m_format(format)
+  , m_file(fopen(filename.c_str(), format == ASTExportFormat::BINARY ? "wb" : "w"))
+  , m_out(nullptr)
+  , m_num_types(0)
+  , m_num_nodes(0)
+  , m_last_file(nullptr)
+  , m_last_file_id(0) {
+  static_assert(sizeof(SCHEMA) / sizeof(SCHEMA[0]) == AREC_NUM_RECORDS,
+                "every record type must have a schema");
+  if (m_file == nullptr) {
+    RuntimeError::raise("Couldn't write AST export file '%s'", filename.c_str());
+  }
+  m_out = new OutputBuffer(m_file, OutputBuffer::DEFAULT_SIZE * 4);
+  write_schema();
+}
+
+ASTExporter::~ASTExporter() {
+  // any text that can't be written is discarded
+  delete m_out;
+  fclose(m_file);
+}
+
+void ASTExporter::write_declaration(Node *decl) {
+  // Types are identified by object identity, but in --stream mode,
+  // they can be freed (and their memory reused) once the declaration
+  // has been analyzed, so they are only looked up within a declaration
+  m_type_ids.clear();
+
+  begin_record(AREC_DECLARATION);
+  end_record();
+
+  // preorder traversal, with an explicit stack (see Node::preorder)
+  m_stack.clear();
+  m_stack.push_back(std::make_pair(decl, NO_PARENT));
+  while (!m_stack.empty()) {
+    Node *n = m_stack.back().first;
+    unsigned long parent = m_stack.back().second;
+    m_stack.pop_back();
+
+    unsigned long id = m_num_nodes++;
+    write_node(n, id, parent);
+    for (unsigned i = n->get_num_kids(); i > 0; --i)
+      m_stack.push_back(std::make_pair(n->get_kid(i - 1), id));
+  }
+}
+
+void ASTExporter::finish() {
+  begin_record(AREC_END);
+  end_record();
+  m_out->flush();
+  if (fflush(m_file) != 0) {
+    RuntimeError::raise("Error writing AST export file '%s'", m_filename.c_str());
+  }
+}
+
+void ASTExporter::write_schema() {
+  if (m_format == ASTExportFormat::NDJSON) {
+    // field names are given in each record
+    m_out->append("{\"record\":\"header\",\"format\":\"nearly_cc-ast\",\"version\":");
+    m_out->append_int(FORMAT_VERSION);
+    m_out->append("}\n");
+    return;
+  }
+
+  m_out->append(MAGIC, MAGIC_LEN);
+  put_varint(FORMAT_VERSION);
+  for (unsigned i = 0; i < AREC_NUM_RECORDS; ++i) {
+    const RecordSchema &schema = SCHEMA[i];
+    assert(schema.rec == ASTExportRecord(i));
+    put_varint(AREC_SCHEMA);
+    put_varint(schema.rec);
+    put_varint(strlen(schema.name));
+    m_out->append(schema.name);
+    put_varint(schema.fields.size());
+    for (auto j = schema.fields.begin(); j != schema.fields.end(); ++j) {
+      put_varint(strlen(*j));
+      m_out->append(*j);
+    }
+  }
+}
+
+void ASTExporter::write_node(Node *n, unsigned long id, unsigned long parent) {
+  // write the records that the node refers to first
+  const std::string &tag_name = encode_tag(n->get_tag());
+  const Location &loc = n->get_loc();
+  unsigned file_id = loc.is_valid() ? encode_file(loc.get_srcfile()) : 0;
+  bool has_type = n->has_type();
+  unsigned type_id = has_type ? encode_type(n->get_type().get()) : 0;
+
+  begin_record(AREC_NODE);
+  if (m_format == ASTExportFormat::NDJSON) {
+    put_id(id);
+    put_name("parent");
+    if (parent == NO_PARENT)
+      m_out->append("null", 4);
+    else
+      m_out->append_int(long(parent));
+  }
+  put_enum("tag", unsigned(n->get_tag()), tag_name.c_str());
+  put_uint("num_kids", n->get_num_kids());
+  put_str("str", n->get_str());
+  put_ref("file", loc.is_valid(), file_id);
+  put_uint("line", loc.is_valid() ? loc.get_line() : 0);
+  put_uint("col", loc.is_valid() ? loc.get_col() : 0);
+  put_ref("type", has_type, type_id);
+  ValueType value_type = n->get_value_type();
+  put_enum("value_type", unsigned(value_type), value_type == COMPUTED ? "computed" : "normal");
+  end_record();
+}
+
+const std::string &ASTExporter::encode_tag(int tag) {
+  assert(tag >= 0);
+  unsigned index = unsigned(tag);
+  if (index >= m_tag_names.size())
+    m_tag_names.resize(index + 1);
+  std::string &name = m_tag_names[index];
+  if (name.empty()) {
+    name = m_names.node_tag_to_string(tag);
+    if (m_format == ASTExportFormat::BINARY) {
+      begin_record(AREC_TAG);
+      put_uint("tag", index);
+      put_str("name", name);
+      end_record();
+    }
+  }
+  return name;
+}
+
+unsigned ASTExporter::encode_file(const std::string &filename) {
+  if (m_last_file != nullptr && *m_last_file == filename)
+    return m_last_file_id;
+
+  auto i = m_file_ids.find(filename);
+  if (i == m_file_ids.end()) {
+    unsigned id = unsigned(m_file_ids.size());
+    i = m_file_ids.insert(std::make_pair(filename, id)).first;
+    begin_record(AREC_FILE);
+    put_id(id);
+    put_str("name", filename);
+    end_record();
+  }
+  // the key in the map stays valid, unlike the argument
+  m_last_file = &i->first;
+  m_last_file_id = i->second;
+  return i->second;
+}
+
+// Make sure that a record describing the given type has been written
+// (in the current declaration), and return its type number. As in
+// interface files, the members of a struct are written in a separate
+// record following the struct, so that they can refer to it.
+unsigned ASTExporter::encode_type(const Type *type) {
+  auto i = m_type_ids.find(type);
+  if (i != m_type_ids.end())
+    return i->second;
+
+  if (type->get_unqualified_type() != type) {
+    // QualifiedType: this check must come first, since
+    // a QualifiedType has the kind of its delegate
+    unsigned base_id = encode_type(type->get_base_type().get());
+    begin_record(AREC_QUALIFIED_TYPE);
+    put_id(m_num_types);
+    put_uint("base", base_id);
+    if (type->is_const())
+      put_enum("qualifier", unsigned(TypeQualifier::CONST), "const");
+    else
+      put_enum("qualifier", unsigned(TypeQualifier::VOLATILE), "volatile");
+    end_record();
+  } else {
+    switch (type->get_kind()) {
+    case TypeKind::BASIC:
+      begin_record(AREC_BASIC_TYPE);
+      put_id(m_num_types);
+      put_enum("kind", unsigned(type->get_basic_type_kind()),
+               basic_type_kind_name(type->get_basic_type_kind()));
+      put_bool("signed", type->is_signed());
+      end_record();
+      break;
+
+    case TypeKind::STRUCT:
+      {
+        const StructType *struct_type = static_cast<const StructType *>(type);
+        begin_record(AREC_STRUCT_TYPE);
+        put_id(m_num_types);
+        put_str("name", struct_type->get_name());
+        end_record();
+        unsigned id = m_num_types++;
+        m_type_ids[type] = id;
+        encode_members(type);
+        return id;
+      }
+
+    case TypeKind::POINTER:
+      {
+        unsigned base_id = encode_type(type->get_base_type().get());
+        begin_record(AREC_POINTER_TYPE);
+        put_id(m_num_types);
+        put_uint("base", base_id);
+        end_record();
+      }
+      break;
+
+    case TypeKind::ARRAY:
+      {
+        unsigned base_id = encode_type(type->get_base_type().get());
+        begin_record(AREC_ARRAY_TYPE);
+        put_id(m_num_types);
+        put_uint("base", base_id);
+        put_uint("size", type->get_array_size());
+        end_record();
+      }
+      break;
+
+    case TypeKind::FUNCTION:
+      {
+        unsigned base_id = encode_type(type->get_base_type().get());
+        for (unsigned j = 0; j < type->get_num_members(); ++j)
+          encode_type(type->get_member(j).get_type().get());
+        begin_record(AREC_FUNCTION_TYPE);
+        put_id(m_num_types);
+        put_uint("base", base_id);
+        put_members(type);
+        end_record();
+      }
+      break;
+
+    case TypeKind::ERROR:
+      begin_record(AREC_ERROR_TYPE);
+      put_id(m_num_types);
+      end_record();
+      break;
+    }
+  }
+
+  unsigned id = m_num_types++;
+  m_type_ids[type] = id;
+  return id;
+}
+
+void ASTExporter::encode_members(const Type *type) {
+  for (unsigned j = 0; j < type->get_num_members(); ++j)
+    encode_type(type->get_member(j).get_type().get());
+
+  begin_record(AREC_STRUCT_MEMBERS);
+  put_uint("struct", m_type_ids[type]);
+  put_members(type);
+  end_record();
+}
+
+////////////////////////////////////////////////////////////////////////
+// Record framing
+////////////////////////////////////////////////////////////////////////
+
+void ASTExporter::begin_record(ASTExportRecord rec) {
+  if (m_format == ASTExportFormat::BINARY) {
+    put_varint(rec);
+    return;
+  }
+  m_out->append("{\"record\":\"", 11);
+  m_out->append(SCHEMA[rec].name);
+  m_out->append('"');
+}
+
+void ASTExporter::end_record() {
+  if (m_format == ASTExportFormat::NDJSON)
+    m_out->append("}\n", 2);
+}
+
+void ASTExporter::put_uint(const char *name, uint64_t val) {
+  if (m_format == ASTExportFormat::BINARY) {
+    put_varint(val);
+    return;
+  }
+  put_name(name);
+  m_out->append_int(long(val));
+}
+
+void ASTExporter::put_str(const char *name, const std::string &s) {
+  if (m_format == ASTExportFormat::BINARY) {
+    put_varint(s.size());
+    m_out->append(s);
+    return;
+  }
+  put_name(name);
+  put_json_str(s.data(), s.size());
+}
+
+void ASTExporter::put_bool(const char *name, bool val) {
+  if (m_format == ASTExportFormat::BINARY) {
+    put_varint(val);
+    return;
+  }
+  put_name(name);
+  if (val)
+    m_out->append("true", 4);
+  else
+    m_out->append("false", 5);
+}
+
+void ASTExporter::put_enum(const char *name, unsigned val, const char *val_name) {
+  if (m_format == ASTExportFormat::BINARY) {
+    put_varint(val);
+    return;
+  }
+  put_name(name);
+  put_json_str(val_name, strlen(val_name));
+}
+
+void ASTExporter::put_ref(const char *name, bool present, uint64_t id) {
+  if (m_format == ASTExportFormat::BINARY) {
+    put_varint(present ? id + 1 : 0);
+    return;
+  }
+  put_name(name);
+  if (present)
+    m_out->append_int(long(id));
+  else
+    m_out->append("null", 4);
+}
+
+void ASTExporter::put_id(uint64_t id) {
+  // the binary format doesn't need the ids, since
+  // records are numbered in order
+  if (m_format == ASTExportFormat::NDJSON)
+    put_uint("id", id);
+}
+
+void ASTExporter::put_members(const Type *type) {
+  unsigned num_members = type->get_num_members();
+  if (m_format == ASTExportFormat::BINARY) {
+    put_varint(num_members);
+    for (unsigned j = 0; j < num_members; ++j) {
+      const Member &member = type->get_member(j);
+      put_str("name", member.get_name());
+      put_varint(m_type_ids[member.get_type().get()]);
+    }
+    return;
+  }
+
+  put_name("members");
+  m_out->append('[');
+  for (unsigned j = 0; j < num_members; ++j) {
+    const Member &member = type->get_member(j);
+    if (j > 0)
+      m_out->append(',');
+    m_out->append("{\"name\":", 8);
+    put_json_str(member.get_name().data(), member.get_name().size());
+    m_out->append(",\"type\":", 8);
+    m_out->append_int(long(m_type_ids[member.get_type().get()]));
+    m_out->append('}');
+  }
+  m_out->append(']');
+}
+
+void ASTExporter::put_name(const char *name) {
+  // every record starts with the "record" member, so each
+  // field is preceded by a comma
+  m_out->append(",\"", 2);
+  m_out->append(name);
+  m_out->append("\":", 2);
+}
+
+void ASTExporter::put_varint(uint64_t val) {
+  char buf[10];
+  unsigned len = 0;
+  do {
+    unsigned char byte = val & 0x7F;
+    val >>= 7;
+    if (val != 0)
+      byte |= 0x80;
+    buf[len++] = char(byte);
+  } while (val != 0);
+  m_out->append(buf, len);
+}
+
+void ASTExporter::put_json_str(const char *s, size_t len) {
+  m_out->append('"');
+  cpputil::append_json_escaped(*m_out, s, len);
+  m_out->append('"');
+}
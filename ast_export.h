@@ -0,0 +1,146 @@
+#ifndef AST_EXPORT_H
+#define AST_EXPORT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include "type.h"
+#include "ast.h"
+class Node;
+class OutputBuffer;
+
+// Export of the annotated AST (for --export-ast), so that external
+// tools don't have to parse the output of -p. Each top-level
+// declaration is written as soon as it has been analyzed, in one pass
+// over its nodes, directly to a buffered output file.
+//
+// Binary format: the magic bytes "NCCA", a format version, and then a
+// sequence of records, terminated by an END record. As in interface
+// files (see interface.h), all integers are unsigned LEB128 varints,
+// and strings are written as a length followed by the raw bytes.
+// Each record starts with its record type (an ASTExportRecord).
+// The stream starts with one SCHEMA record for each record type,
+// giving the record type's number and name, and the names of its
+// fields (a field written as a count followed by that many groups
+// of values is named "name[field,...]"), so that tools can check
+// that they understand the stream.
+//
+// A DECLARATION record is followed by the nodes of one top-level
+// declaration, in preorder: each NODE record gives the number of
+// children that follow it. In NODE records, the file and type
+// fields are 0 if the node doesn't have one, and otherwise 1 more
+// than the number of the FILE or type record (each numbered from 0,
+// in order of appearance). A TAG, FILE, or type record is written
+// before the first record that refers to it. Tags and files are
+// written only once, but types are written again in each declaration
+// that refers to them. (Nodes don't refer to symbols, since semantic
+// analysis doesn't record them in the AST.)
+//
+// In type records, other types are referred to by number.
+//
+// NDJSON format: a header object on the first line, followed by one
+// JSON object per line for each record, with a
+// "record" member giving the record name, and the same fields (named
+// as in the schema). There are no SCHEMA or TAG records: node tags,
+// basic type kinds, qualifiers, and value types are written as
+// names rather than numbers, and a missing file or type is null.
+// The numbered records (FILE, type, and NODE records, where nodes are numbered from 0 in order of
+// appearance) also have an "id" member, and NODE records have a
+// "parent" member (null for the root of a declaration). Strings
+// (such as lexemes) are raw bytes from the source: bytes that aren't
+// part of a valid UTF-8 sequence are written as "\u00XX" escapes
+// (i.e., as if they were Latin-1), so that each line is valid JSON.
+
+enum class ASTExportFormat {
+  BINARY,
+  NDJSON,
+};
+
+enum ASTExportRecord {
+  AREC_END = 0,
+  AREC_SCHEMA,
+  AREC_TAG,
+  AREC_FILE,
+  AREC_BASIC_TYPE,
+  AREC_QUALIFIED_TYPE,
+  AREC_POINTER_TYPE,
+  AREC_ARRAY_TYPE,
+  AREC_FUNCTION_TYPE,
+  AREC_STRUCT_TYPE,
+  AREC_STRUCT_MEMBERS,
+  AREC_ERROR_TYPE,
+  AREC_DECLARATION,
+  AREC_NODE,
+  AREC_NUM_RECORDS,
+};
+
+class ASTExporter {
+private:
+  std::string m_filename;
+  ASTExportFormat m_format;
+  FILE *m_file;
+  OutputBuffer *m_out;
+  ASTTreePrint m_names;
+  // names of the tags seen so far (empty for the others)
+  std::vector<std::string> m_tag_names;
+  std::map<std::string, unsigned> m_file_ids;
+  // types written for the current declaration
+  std::unordered_map<const Type *, unsigned> m_type_ids;
+  unsigned m_num_types;
+  unsigned long m_num_nodes;
+  // the most recently used file (nodes are usually in the same
+  // file as the previous node)
+  const std::string *m_last_file;
+  unsigned m_last_file_id;
+  // nodes waiting to be written, and the numbers of their parents
+  std::vector<std::pair<Node *, unsigned long>> m_stack;
+
+  // value semantics prohibited
+  ASTExporter(const ASTExporter &);
+  ASTExporter &operator=(const ASTExporter &);
+
+public:
+  // open the named file and write the header;
+  // throws a RuntimeError if the file can't be written
+  ASTExporter(const std::string &filename, ASTExportFormat format);
+  ~ASTExporter();
+
+  // write a top-level declaration (which should have been analyzed)
+  void write_declaration(Node *decl);
+
+  // write the END record and flush the output
+  void finish();
+
+private:
+  void write_schema();
+  void write_node(Node *n, unsigned long id, unsigned long parent);
+  const std::string &encode_tag(int tag);
+  unsigned encode_file(const std::string &filename);
+  unsigned encode_type(const Type *type);
+  void encode_members(const Type *type);
+
+  // record framing: in the binary format, a record is its type
+  // followed by its fields; in NDJSON, it is an object with a
+  // "record" member, and the fields as named members
+  void begin_record(ASTExportRecord rec);
+  void end_record();
+  void put_uint(const char *name, uint64_t val);
+  void put_str(const char *name, const std::string &s);
+  void put_bool(const char *name, bool val);
+  // an enumeration value: its number (binary) or name (NDJSON)
+  void put_enum(const char *name, unsigned val, const char *val_name);
+  // a reference from a node to a file or type: 0 for none,
+  // or 1 more than its number (binary); null or its number (NDJSON)
+  void put_ref(const char *name, bool present, uint64_t id);
+  void put_id(uint64_t id);
+  void put_members(const Type *type);
+  void put_name(const char *name);
+  void put_varint(uint64_t val);
+  void put_json_str(const char *s, size_t len);
+};
+
+#endif // AST_EXPORT_H
@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <utility>
+#include "node.h"
+#include "ast.h"
+#include "type.h"
+#include "symtab.h"
+#include "ast_stats.h"
+
+namespace {
+
+unsigned get_bucket(unsigned long value) {
+  unsigned bucket = 0;
+  if (value > 0) {
+    // 1 + ceil(log2(value))
+    bucket = 1;
+    for (unsigned long v = value - 1; v != 0; v >>= 1)
+      ++bucket;
+  }
+  return bucket;
+}
+
+std::string get_bucket_label(unsigned bucket) {
+  if (bucket < 3)
+    return std::to_string(bucket);
+  unsigned long lo = (1UL << (bucket - 2)) + 1, hi = 1UL << (bucket - 1);
+  return std::to_string(lo) + "-" + std::to_string(hi);
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////
+// Histogram implementation
+////////////////////////////////////////////////////////////////////////
+
+Histogram::Histogram()
+  : m_count(0)
+  , m_total(0)
+  , m_max(0) {
+}
+
+Histogram::~Histogram() {
+}
+
+void Histogram::add(unsigned long value) {
+  unsigned bucket = get_bucket(value);
+  if (bucket >= m_buckets.size())
+    m_buckets.resize(bucket + 1, 0);
+  ++m_buckets[bucket];
+  ++m_count;
+  m_total += value;
+  if (value > m_max)
+    m_max = value;
+}
+
+void Histogram::print(FILE *out, const char *indent) const {
+  fprintf(out, "%scount %lu, average %.2f, max %lu\n", indent, m_count, get_average(), m_max);
+  for (unsigned i = 0; i < m_buckets.size(); ++i) {
+    if (m_buckets[i] == 0)
+      continue;
+    fprintf(out, "%s  %-14s %12lu %6.1f%%\n", indent, get_bucket_label(i).c_str(),
+            m_buckets[i], 100.0 * m_buckets[i] / m_count);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+// ASTStats implementation
+////////////////////////////////////////////////////////////////////////
+
+ASTStats::ASTStats()
+  : m_num_nodes(0)
+  , m_total_depth(0)
+  , m_max_depth(0)
+  , m_max_scope_depth(0) {
+}
+
+ASTStats::~ASTStats() {
+}
+
+void ASTStats::collect_tree(Node *ast, unsigned long root_depth) {
+  // use an explicit stack rather than recursion,
+  // since the tree may be very deep
+  std::vector<std::pair<Node *, unsigned long>> stack;
+  stack.push_back(std::make_pair(ast, root_depth));
+
+  while (!stack.empty()) {
+    Node *n = stack.back().first;
+    unsigned long depth = stack.back().second;
+    stack.pop_back();
+
+    ++m_num_nodes;
+    ++m_tag_counts[n->get_tag()];
+    m_total_depth += depth;
+    if (depth > m_max_depth)
+      m_max_depth = depth;
+
+    unsigned num_kids = n->get_num_kids();
+    m_fan_out.add(num_kids);
+
+    // leaves that have text are tokens
+    if (num_kids == 0 && !n->get_str().empty()) {
+      m_lexeme_sizes.add(n->get_str().size());
+      if (n->get_tag() == NODE_TOK_IDENT)
+        m_ident_sizes.add(n->get_str().size());
+    }
+
+    if (n->has_type())
+      record_type(n->get_type());
+
+    for (auto i = n->cbegin(); i != n->cend(); ++i)
+      stack.push_back(std::make_pair(*i, depth + 1));
+  }
+}
+
+void ASTStats::collect_streamed_unit(Node *unit, unsigned long num_decls) {
+  ++m_num_nodes;
+  ++m_tag_counts[unit->get_tag()];
+  m_total_depth += 1;
+  if (m_max_depth < 1)
+    m_max_depth = 1;
+  m_fan_out.add(num_decls);
+}
+
+void ASTStats::record_scope(const SymbolTable *symtab) {
+  std::lock_guard<std::mutex> guard(m_scope_lock);
+  m_scope_sizes.add(symtab->get_num_symbols());
+  if (symtab->get_depth() > m_max_scope_depth)
+    m_max_scope_depth = symtab->get_depth();
+
+  for (auto i = symtab->cbegin(); i != symtab->cend(); ++i)
+    record_type((*i)->get_type());
+}
+
+void ASTStats::record_type(const std::shared_ptr<Type> &type) {
+  // only compute the string representation of each Type object once
+  if (m_type_objects.insert(type).second)
+    m_distinct_types.insert(type->as_str());
+}
+
+void ASTStats::print(FILE *out, unsigned long types_allocated) const {
+  ASTTreePrint names;
+
+  fprintf(out, "AST:\n");
+  fprintf(out, "  nodes: %lu\n", m_num_nodes);
+  fprintf(out, "  max depth: %lu\n", m_max_depth);
+  fprintf(out, "  average depth: %.2f\n", m_num_nodes == 0 ? 0.0 : double(m_total_depth) / m_num_nodes);
+
+  // most frequent tags first
+  std::vector<std::pair<unsigned long, int>> tags;
+  for (auto i = m_tag_counts.begin(); i != m_tag_counts.end(); ++i)
+    tags.push_back(std::make_pair(i->second, i->first));
+  std::sort(tags.begin(), tags.end(), [](const std::pair<unsigned long, int> &a, const std::pair<unsigned long, int> &b) {
+    return a.first > b.first || (a.first == b.first && a.second < b.second);
+  });
+  fprintf(out, "Node counts by tag:\n");
+  for (auto i = tags.begin(); i != tags.end(); ++i) {
+    fprintf(out, "  %-36s %12lu %6.1f%%\n", names.node_tag_to_string(i->second).c_str(),
+            i->first, 100.0 * i->first / m_num_nodes);
+  }
+
+  fprintf(out, "Fan-out (children per node):\n");
+  m_fan_out.print(out, "  ");
+  fprintf(out, "Lexeme sizes:\n");
+  m_lexeme_sizes.print(out, "  ");
+  fprintf(out, "Identifier sizes:\n");
+  m_ident_sizes.print(out, "  ");
+
+  fprintf(out, "Scopes:\n");
+  fprintf(out, "  max depth: %d\n", m_max_scope_depth);
+  fprintf(out, "  symbols per scope:\n");
+  m_scope_sizes.print(out, "    ");
+
+  fprintf(out, "Types:\n");
+  fprintf(out, "  distinct types: %lu\n", (unsigned long) m_distinct_types.size());
+  fprintf(out, "  Type objects referenced: %lu\n", (unsigned long) m_type_objects.size());
+  fprintf(out, "  Type objects allocated: %lu\n", types_allocated);
+}
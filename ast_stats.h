@@ -0,0 +1,91 @@
+#ifndef AST_STATS_H
+#define AST_STATS_H
+
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+class Node;
+class Type;
+class SymbolTable;
+
+// Histogram with power-of-two buckets: 0, 1, 2, 3-4, 5-8, 9-16, etc.
+class Histogram {
+private:
+  std::vector<unsigned long> m_buckets;
+  unsigned long m_count, m_total, m_max;
+
+public:
+  Histogram();
+  ~Histogram();
+
+  void add(unsigned long value);
+
+  unsigned long get_count() const { return m_count; }
+  unsigned long get_max() const { return m_max; }
+  double get_average() const { return m_count == 0 ? 0.0 : double(m_total) / m_count; }
+
+  void print(FILE *out, const char *indent) const;
+};
+
+// Statistics about the shape of an AST and the symbol tables
+// built by semantic analysis (for --stats). This is useful for
+// choosing the sizes of arenas and hash tables, and for finding
+// out why a particular input is slow to compile.
+class ASTStats {
+private:
+  std::map<int, unsigned long> m_tag_counts;
+  unsigned long m_num_nodes;
+  unsigned long m_total_depth;
+  unsigned long m_max_depth;
+  Histogram m_fan_out;
+  Histogram m_lexeme_sizes;
+  Histogram m_ident_sizes;
+  Histogram m_scope_sizes;
+  int m_max_scope_depth;
+  // Type objects are kept alive, so that their addresses can't be
+  // reused (Types are freed along with the AST when declarations
+  // are analyzed as they are parsed)
+  std::set<std::shared_ptr<Type>> m_type_objects;
+  std::set<std::string> m_distinct_types;
+  // scopes may be recorded by several threads at once
+  // (when function bodies are analyzed in parallel)
+  std::mutex m_scope_lock;
+
+  // value semantics prohibited
+  ASTStats(const ASTStats &);
+  ASTStats &operator=(const ASTStats &);
+
+public:
+  ASTStats();
+  ~ASTStats();
+
+  // gather statistics about the nodes in the given tree
+  // (after semantic analysis, so that types are known);
+  // root_depth is the depth of the tree's root in the whole AST
+  // (which is not 1 if the tree is a single top-level declaration)
+  void collect_tree(Node *ast, unsigned long root_depth = 1);
+
+  // gather statistics about the unit node left after each of its
+  // top-level declarations was collected (with root_depth 2) and
+  // deleted, as when declarations are analyzed as they are parsed
+  void collect_streamed_unit(Node *unit, unsigned long num_decls);
+
+  // record the symbols in a scope; semantic analysis calls this
+  // as each scope is left, and it should also be called for
+  // the global scope
+  void record_scope(const SymbolTable *symtab);
+
+  // print the statistics; types_allocated is the total number
+  // of Type objects created, for comparison with the number of
+  // distinct types
+  void print(FILE *out, unsigned long types_allocated) const;
+
+private:
+  void record_type(const std::shared_ptr<Type> &type);
+};
+
+#endif // AST_STATS_H
@@ -0,0 +1,408 @@
+// Benchmark harness for the compiler front end.
+//
+// Each phase of the front end (lexing, parsing, and semantic analysis)
+// is measured separately on each input file (lexing and parsing with
+// both the flex scanner and the DirectLexer), along with microbenchmarks
+// of SymbolTable insertion/lookup and Type construction/comparison.
+// For each benchmark, the best and median times over several iterations
+// are reported, along with throughput and the number of heap
+// allocations (and bytes allocated, including allocator rounding)
+// per iteration.
+//
+// Usage: nearly_bench [--iters=N] [--json] <filename...>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <memory>
+#include "node.h"
+#include "type.h"
+#include "symtab.h"
+#include "context.h"
+#include "semantic_analysis.h"
+#include "exceptions.h"
+#include "cpputil.h"
+#include "memstats.h"
+#include "direct_lexer.h"
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////
+// Benchmark driver
+////////////////////////////////////////////////////////////////////////
+
+typedef std::chrono::steady_clock Clock;
+
+// Measures one iteration of a benchmark. By default the entire
+// iteration is measured, but a benchmark can call start() and stop()
+// to exclude setup and teardown work.
+class Stopwatch {
+private:
+  Clock::time_point m_start, m_end;
+  unsigned long m_allocs, m_alloc_bytes;
+  bool m_stopped;
+
+public:
+  Stopwatch() { start(); }
+
+  void start() {
+    m_stopped = false;
+    m_allocs = MemStats::get_total_allocs();
+    m_alloc_bytes = MemStats::get_total_bytes();
+    m_start = Clock::now();
+  }
+
+  void stop() {
+    if (m_stopped)
+      return;
+    m_end = Clock::now();
+    m_allocs = MemStats::get_total_allocs() - m_allocs;
+    m_alloc_bytes = MemStats::get_total_bytes() - m_alloc_bytes;
+    m_stopped = true;
+  }
+
+  double get_secs() const { return std::chrono::duration<double>(m_end - m_start).count(); }
+  unsigned long get_allocs() const { return m_allocs; }
+  unsigned long get_alloc_bytes() const { return m_alloc_bytes; }
+};
+
+struct BenchResult {
+  std::string name;
+  std::string input;
+  std::string unit;          // what items are being counted (tokens, nodes, etc.)
+  unsigned long items;       // number of items processed per iteration
+  unsigned iters;
+  double best_secs, median_secs;
+  unsigned long allocs;      // allocations per iteration
+  unsigned long alloc_bytes; // bytes allocated per iteration
+
+  double get_items_per_sec() const { return best_secs > 0.0 ? items / best_secs : 0.0; }
+};
+
+struct Options {
+  unsigned iters;
+  bool json;
+  std::vector<std::string> filenames;
+};
+
+std::vector<BenchResult> g_results;
+
+// Run a benchmark the requested number of times.
+// The function fn is called with a Stopwatch, and should
+// return the number of items processed.
+template<typename Fn>
+void run_bench(const Options &opts, const std::string &name, const std::string &input,
+               const std::string &unit, Fn fn) {
+  BenchResult r;
+  r.name = name;
+  r.input = input;
+  r.unit = unit;
+  r.iters = opts.iters;
+  r.items = 0;
+  r.allocs = r.alloc_bytes = 0;
+
+  std::vector<double> times;
+  for (unsigned i = 0; i < opts.iters; ++i) {
+    Stopwatch sw;
+    r.items = fn(sw);
+    sw.stop();
+    times.push_back(sw.get_secs());
+
+    // allocation counts should be the same on every iteration,
+    // so just keep the last one
+    r.allocs = sw.get_allocs();
+    r.alloc_bytes = sw.get_alloc_bytes();
+  }
+
+  std::sort(times.begin(), times.end());
+  r.best_secs = times.front();
+  r.median_secs = times[times.size() / 2];
+  g_results.push_back(r);
+}
+
+unsigned long count_nodes(Node *root) {
+  unsigned long count = 0;
+  root->preorder([&count](Node *) { ++count; });
+  return count;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Front end phases
+////////////////////////////////////////////////////////////////////////
+
+void bench_lex(const Options &opts, const std::string &filename,
+               const std::string &name, LexerKind lexer_kind) {
+  run_bench(opts, name, filename, "tokens", [&](Stopwatch &sw) {
+    Context ctx;
+    ctx.set_lexer(lexer_kind);
+    std::vector<Node *> tokens;
+    ctx.scan_tokens(filename, tokens);
+    sw.stop();
+    for (auto i = tokens.begin(); i != tokens.end(); ++i)
+      delete *i;
+    return tokens.size();
+  });
+}
+
+// scan tokens with the DirectLexer without creating Nodes for them,
+// to measure the cost of recognizing tokens by itself
+void bench_lex_raw(const Options &opts, const std::string &filename) {
+  run_bench(opts, "lex_direct_raw", filename, "tokens", [&](Stopwatch &sw) {
+    std::unique_ptr<FILE, int (*)(FILE *)> in(fopen(filename.c_str(), "r"), fclose);
+    if (!in) {
+      RuntimeError::raise("Couldn't open '%s'", filename.c_str());
+    }
+    Location loc(filename, 1, 1);
+    DirectLexer lexer(loc);
+    lexer.read_input(in.get());
+
+    sw.start();
+    Token tok;
+    unsigned long count = 0;
+    while (lexer.next(tok) != 0)
+      ++count;
+    sw.stop();
+
+    return count;
+  });
+}
+
+void bench_parse(const Options &opts, const std::string &filename,
+                 const std::string &name, LexerKind lexer_kind) {
+  run_bench(opts, name, filename, "nodes", [&](Stopwatch &sw) {
+    Context ctx;
+    ctx.set_lexer(lexer_kind);
+    ctx.parse(filename);
+    sw.stop();
+    return count_nodes(ctx.get_ast());
+  });
+}
+
+void bench_sema(const Options &opts, const std::string &filename) {
+  run_bench(opts, "sema", filename, "nodes", [&](Stopwatch &sw) {
+    // semantic analysis annotates the AST, so each
+    // iteration needs a freshly parsed one
+    Context ctx;
+    ctx.parse(filename);
+
+    // the symbol table entries are not printed, since we're
+    // not interested in measuring the cost of stdio
+    sw.start();
+    {
+      SemanticAnalysis sema;
+      sema.get_global_symtab()->set_print_entries(false);
+      sema.visit(ctx.get_ast());
+    }
+    sw.stop();
+
+    return count_nodes(ctx.get_ast());
+  });
+}
+
+////////////////////////////////////////////////////////////////////////
+// Microbenchmarks
+////////////////////////////////////////////////////////////////////////
+
+const unsigned NUM_SYMBOLS = 10000;
+const unsigned SCOPE_DEPTH = 8;
+const unsigned NUM_TYPES = 10000;
+
+std::vector<std::string> make_names(unsigned count) {
+  std::vector<std::string> names;
+  for (unsigned i = 0; i < count; ++i)
+    names.push_back("sym" + std::to_string(i));
+  return names;
+}
+
+void bench_symtab(const Options &opts) {
+  std::vector<std::string> names = make_names(NUM_SYMBOLS);
+  std::shared_ptr<Type> int_type(new BasicType(BasicTypeKind::INT, true));
+
+  run_bench(opts, "symtab_insert", "", "symbols", [&](Stopwatch &sw) {
+    SymbolTable symtab(nullptr);
+    symtab.set_print_entries(false);
+    sw.start();
+    for (auto i = names.begin(); i != names.end(); ++i)
+      symtab.define(SymbolKind::VARIABLE, *i, int_type);
+    sw.stop();
+    return names.size();
+  });
+
+  // Look up each name from the innermost of a chain of nested
+  // scopes, so that each lookup searches all of the enclosing scopes
+  // (as is the case for references to global variables and functions
+  // from within a function body)
+  run_bench(opts, "symtab_lookup", "", "lookups", [&](Stopwatch &sw) {
+    std::vector<std::unique_ptr<SymbolTable>> scopes;
+    scopes.emplace_back(new SymbolTable(nullptr));
+    scopes.back()->set_print_entries(false);
+    for (auto i = names.begin(); i != names.end(); ++i)
+      scopes.back()->define(SymbolKind::VARIABLE, *i, int_type);
+    for (unsigned i = 0; i < SCOPE_DEPTH; ++i)
+      scopes.emplace_back(new SymbolTable(scopes.back().get()));
+
+    const SymbolTable *innermost = scopes.back().get();
+    unsigned long found = 0;
+    sw.start();
+    for (auto i = names.begin(); i != names.end(); ++i) {
+      if (innermost->lookup_recursive(*i) != nullptr)
+        ++found;
+    }
+    sw.stop();
+
+    if (found != names.size())
+      RuntimeError::raise("symtab_lookup: only found %lu of %u symbols", found, NUM_SYMBOLS);
+
+    // scopes must be destroyed innermost first
+    while (!scopes.empty())
+      scopes.pop_back();
+
+    return names.size();
+  });
+}
+
+// Build the type "const int *(*)[4]" (pointer to array of pointers
+// to const int), which exercises most of the Type subclasses
+std::shared_ptr<Type> make_test_type() {
+  std::shared_ptr<Type> int_type(new BasicType(BasicTypeKind::INT, true));
+  std::shared_ptr<Type> const_int(new QualifiedType(int_type, TypeQualifier::CONST));
+  std::shared_ptr<Type> ptr(new PointerType(const_int));
+  std::shared_ptr<Type> arr(new ArrayType(ptr, 4));
+  return std::shared_ptr<Type>(new PointerType(arr));
+}
+
+// Build the type of a function taking (char, long *) and returning int
+std::shared_ptr<Type> make_test_fn_type() {
+  std::shared_ptr<Type> fn_type(new FunctionType(std::make_shared<BasicType>(BasicTypeKind::INT, true)));
+  fn_type->add_member(Member("a", std::make_shared<BasicType>(BasicTypeKind::CHAR, true)));
+  std::shared_ptr<Type> long_type(new BasicType(BasicTypeKind::LONG, true));
+  fn_type->add_member(Member("b", std::make_shared<PointerType>(long_type)));
+  return fn_type;
+}
+
+void bench_types(const Options &opts) {
+  run_bench(opts, "type_construct", "", "types", [&](Stopwatch &) {
+    std::vector<std::shared_ptr<Type>> types;
+    types.reserve(2 * NUM_TYPES);
+    for (unsigned i = 0; i < NUM_TYPES; ++i) {
+      types.push_back(make_test_type());
+      types.push_back(make_test_fn_type());
+    }
+    return types.size();
+  });
+
+  // Compare structurally identical (but distinct) types
+  std::vector<std::shared_ptr<Type>> lhs, rhs;
+  for (unsigned i = 0; i < NUM_TYPES; ++i) {
+    lhs.push_back(i % 2 == 0 ? make_test_type() : make_test_fn_type());
+    rhs.push_back(i % 2 == 0 ? make_test_type() : make_test_fn_type());
+  }
+
+  run_bench(opts, "type_is_same", "", "comparisons", [&](Stopwatch &) {
+    unsigned long same = 0;
+    for (unsigned i = 0; i < NUM_TYPES; ++i) {
+      if (lhs[i]->is_same(rhs[i].get()))
+        ++same;
+    }
+    if (same != NUM_TYPES)
+      RuntimeError::raise("type_is_same: only %lu of %u types compared equal", same, NUM_TYPES);
+    return (unsigned long) NUM_TYPES;
+  });
+}
+
+////////////////////////////////////////////////////////////////////////
+// Reporting
+////////////////////////////////////////////////////////////////////////
+
+void print_table() {
+  printf("%-16s %-24s %12s %12s %12s %16s %12s %14s\n",
+         "benchmark", "input", "items", "best ms", "median ms", "items/s", "allocs", "alloc bytes");
+  for (auto i = g_results.begin(); i != g_results.end(); ++i) {
+    std::string input = i->input.empty() ? "-" : i->input;
+    printf("%-16s %-24s %12lu %12.3f %12.3f %16.0f %12lu %14lu  (%s)\n",
+           i->name.c_str(), input.c_str(), i->items,
+           i->best_secs * 1000.0, i->median_secs * 1000.0, i->get_items_per_sec(),
+           i->allocs, i->alloc_bytes, i->unit.c_str());
+  }
+}
+
+void print_json() {
+  printf("{\n  \"benchmarks\": [\n");
+  for (auto i = g_results.begin(); i != g_results.end(); ++i) {
+    printf("    {\"name\": \"%s\", \"input\": \"%s\", \"unit\": \"%s\", \"items\": %lu, "
+           "\"iterations\": %u, \"best_ns\": %.0f, \"median_ns\": %.0f, \"items_per_sec\": %.0f, "
+           "\"allocs\": %lu, \"alloc_bytes\": %lu}%s\n",
+           cpputil::json_escape(i->name).c_str(), cpputil::json_escape(i->input).c_str(), i->unit.c_str(),
+           i->items, i->iters, i->best_secs * 1e9, i->median_secs * 1e9, i->get_items_per_sec(),
+           i->allocs, i->alloc_bytes, (i + 1 == g_results.end()) ? "" : ",");
+  }
+  printf("  ]\n}\n");
+}
+
+int usage() {
+  fprintf(stderr,
+          "Usage: nearly_bench [options...] <filename...>\n"
+          "Options:\n"
+          "  --iters=N  run each benchmark N times (default 5)\n"
+          "  --json     print results as JSON\n");
+  return 1;
+}
+
+}
+
+int main(int argc, char **argv) {
+  // count allocations (see memstats.h)
+  MemStats::set_enabled(true);
+
+  Options opts;
+  opts.iters = 5;
+  opts.json = false;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "--json") {
+      opts.json = true;
+    } else if (arg.compare(0, 8, "--iters=") == 0) {
+      int iters = atoi(arg.c_str() + 8);
+      if (iters <= 0)
+        return usage();
+      opts.iters = unsigned(iters);
+    } else if (arg.compare(0, 1, "-") == 0) {
+      return usage();
+    } else {
+      opts.filenames.push_back(arg);
+    }
+  }
+
+  try {
+    for (auto i = opts.filenames.begin(); i != opts.filenames.end(); ++i) {
+      bench_lex(opts, *i, "lex", LexerKind::FLEX);
+      bench_lex(opts, *i, "lex_direct", LexerKind::DIRECT);
+      bench_lex_raw(opts, *i);
+      bench_parse(opts, *i, "parse", LexerKind::FLEX);
+      bench_parse(opts, *i, "parse_direct", LexerKind::DIRECT);
+      bench_sema(opts, *i);
+    }
+    bench_symtab(opts);
+    bench_types(opts);
+  } catch (BaseException &ex) {
+    const Location &loc = ex.get_loc();
+    if (loc.is_valid()) {
+      fprintf(stderr, "%s:%d:%d:Error: %s\n", loc.get_srcfile().c_str(), loc.get_line(), loc.get_col(), ex.what());
+    } else {
+      fprintf(stderr, "Error: %s\n", ex.what());
+    }
+    return 1;
+  }
+
+  if (opts.json)
+    print_json();
+  else
+    print_table();
+
+  return 0;
+}
@@ -0,0 +1,301 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <csignal>
+#include <cerrno>
+#include <climits>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "exceptions.h"
+#include "compile_server.h"
+
+namespace {
+
+// Upper limit on the size of a request, to guard against garbage
+const uint32_t MAX_REQUEST_SIZE = 1U << 24;
+
+sockaddr_un make_address(const std::string &socket_path) {
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr.sun_path)) {
+    RuntimeError::raise("Socket path '%s' is too long", socket_path.c_str());
+  }
+  strcpy(addr.sun_path, socket_path.c_str());
+  return addr;
+}
+
+bool write_fully(int fd, const void *buf, size_t len) {
+  const char *p = static_cast<const char *>(buf);
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= size_t(n);
+  }
+  return true;
+}
+
+bool read_fully(int fd, void *buf, size_t len) {
+  char *p = static_cast<char *>(buf);
+  while (len > 0) {
+    ssize_t n = read(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= size_t(n);
+  }
+  return true;
+}
+
+void put_u32(std::string &buf, uint32_t val) {
+  buf.append(reinterpret_cast<const char *>(&val), sizeof(val));
+}
+
+bool get_u32(const std::string &buf, size_t &pos, uint32_t &val) {
+  if (buf.size() - pos < sizeof(val))
+    return false;
+  memcpy(&val, buf.data() + pos, sizeof(val));
+  pos += sizeof(val);
+  return true;
+}
+
+// Redirects stdout and stderr to the given file descriptors
+// for the lifetime of the object
+class RedirectOutput {
+private:
+  int m_saved_out, m_saved_err;
+
+public:
+  RedirectOutput(int out_fd, int err_fd) {
+    fflush(stdout);
+    fflush(stderr);
+    m_saved_out = dup(STDOUT_FILENO);
+    m_saved_err = dup(STDERR_FILENO);
+    dup2(out_fd, STDOUT_FILENO);
+    dup2(err_fd, STDERR_FILENO);
+  }
+
+  ~RedirectOutput() {
+    fflush(stdout);
+    fflush(stderr);
+    dup2(m_saved_out, STDOUT_FILENO);
+    dup2(m_saved_err, STDERR_FILENO);
+    close(m_saved_out);
+    close(m_saved_err);
+  }
+};
+
+}
+
+////////////////////////////////////////////////////////////////////////
+// CompileServer implementation
+////////////////////////////////////////////////////////////////////////
+
+CompileServer::CompileServer(const std::string &socket_path, CompileFn compile_fn)
+  : m_socket_path(socket_path)
+  , m_compile_fn(compile_fn)
+  , m_listen_fd(-1) {
+}
+
+CompileServer::~CompileServer() {
+  if (m_listen_fd >= 0) {
+    close(m_listen_fd);
+    unlink(m_socket_path.c_str());
+  }
+}
+
+void CompileServer::run() {
+  sockaddr_un addr = make_address(m_socket_path);
+
+  // a client going away while we're writing to its
+  // output shouldn't take down the server
+  signal(SIGPIPE, SIG_IGN);
+
+  m_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (m_listen_fd < 0) {
+    RuntimeError::raise("Couldn't create socket: %s", strerror(errno));
+  }
+
+  // remove a stale socket left behind by a previous server
+  unlink(m_socket_path.c_str());
+  if (bind(m_listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0
+      || listen(m_listen_fd, SOMAXCONN) < 0) {
+    RuntimeError::raise("Couldn't listen on '%s': %s", m_socket_path.c_str(), strerror(errno));
+  }
+
+  for (;;) {
+    int conn_fd = accept(m_listen_fd, nullptr, nullptr);
+    if (conn_fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      RuntimeError::raise("accept failed: %s", strerror(errno));
+    }
+    handle_request(conn_fd);
+    close(conn_fd);
+  }
+}
+
+void CompileServer::handle_request(int conn_fd) {
+  // The request header is the payload size, and carries the
+  // client's stdout and stderr file descriptors
+  uint32_t size;
+  iovec iov;
+  iov.iov_base = &size;
+  iov.iov_len = sizeof(size);
+
+  union {
+    cmsghdr align;
+    char buf[CMSG_SPACE(2 * sizeof(int))];
+  } control;
+
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  if (recvmsg(conn_fd, &msg, MSG_WAITALL) != ssize_t(sizeof(size)))
+    return;
+
+  int fds[2] = { -1, -1 };
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg != nullptr && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS
+      && cmsg->cmsg_len == CMSG_LEN(2 * sizeof(int))) {
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+  }
+
+  // The payload is the working directory followed by the arguments
+  std::string payload;
+  std::vector<std::string> args;
+  bool valid = fds[0] >= 0 && fds[1] >= 0 && size <= MAX_REQUEST_SIZE;
+  if (valid) {
+    payload.resize(size);
+    valid = read_fully(conn_fd, &payload[0], size);
+  }
+  size_t pos = 0;
+  uint32_t count = 0;
+  valid = valid && get_u32(payload, pos, count);
+  for (uint32_t i = 0; valid && i < count; ++i) {
+    uint32_t len;
+    valid = get_u32(payload, pos, len) && payload.size() - pos >= len;
+    if (valid) {
+      args.push_back(payload.substr(pos, len));
+      pos += len;
+    }
+  }
+  valid = valid && !args.empty();
+
+  int32_t status = 1;
+  if (valid) {
+    std::string cwd = args[0];
+    args.erase(args.begin());
+    status = run_compile_in(cwd, args, fds[0], fds[1]);
+  }
+
+  if (fds[0] >= 0)
+    close(fds[0]);
+  if (fds[1] >= 0)
+    close(fds[1]);
+
+  write_fully(conn_fd, &status, sizeof(status));
+}
+
+int CompileServer::run_compile_in(const std::string &cwd, const std::vector<std::string> &args, int out_fd, int err_fd) {
+  char saved_cwd[PATH_MAX];
+  if (getcwd(saved_cwd, sizeof(saved_cwd)) == nullptr)
+    return 1;
+
+  RedirectOutput redirect(out_fd, err_fd);
+  if (chdir(cwd.c_str()) < 0) {
+    fprintf(stderr, "Error: Couldn't change to directory '%s'\n", cwd.c_str());
+    return 1;
+  }
+
+  int status;
+  try {
+    status = m_compile_fn(args);
+  } catch (std::exception &ex) {
+    fprintf(stderr, "Error: %s\n", ex.what());
+    status = 1;
+  }
+
+  if (chdir(saved_cwd) < 0) {
+    RuntimeError::raise("Couldn't return to directory '%s'", saved_cwd);
+  }
+  return status;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Client
+////////////////////////////////////////////////////////////////////////
+
+int forward_to_server(const std::string &socket_path, const std::vector<std::string> &args) {
+  sockaddr_un addr = make_address(socket_path);
+
+  char cwd[PATH_MAX];
+  if (getcwd(cwd, sizeof(cwd)) == nullptr) {
+    RuntimeError::raise("Couldn't get working directory: %s", strerror(errno));
+  }
+
+  std::string payload;
+  put_u32(payload, uint32_t(args.size() + 1));
+  put_u32(payload, uint32_t(strlen(cwd)));
+  payload += cwd;
+  for (auto i = args.begin(); i != args.end(); ++i) {
+    put_u32(payload, uint32_t(i->size()));
+    payload += *i;
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+    if (fd >= 0)
+      close(fd);
+    RuntimeError::raise("Couldn't connect to compile server at '%s': %s", socket_path.c_str(), strerror(errno));
+  }
+
+  // send the header along with our stdout and stderr
+  uint32_t size = uint32_t(payload.size());
+  iovec iov;
+  iov.iov_base = &size;
+  iov.iov_len = sizeof(size);
+
+  union {
+    cmsghdr align;
+    char buf[CMSG_SPACE(2 * sizeof(int))];
+  } control;
+  memset(control.buf, 0, sizeof(control.buf));
+
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+  int fds[2] = { STDOUT_FILENO, STDERR_FILENO };
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  int32_t status;
+  bool ok = sendmsg(fd, &msg, 0) == ssize_t(sizeof(size))
+         && write_fully(fd, payload.data(), payload.size())
+         && read_fully(fd, &status, sizeof(status));
+  close(fd);
+
+  if (!ok) {
+    RuntimeError::raise("Lost connection to compile server at '%s'", socket_path.c_str());
+  }
+  return status;
+}
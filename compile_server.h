@@ -0,0 +1,54 @@
+#ifndef COMPILE_SERVER_H
+#define COMPILE_SERVER_H
+
+#include <string>
+#include <vector>
+
+// Runs one compilation, given the command line arguments (not
+// including the program name), and returns the exit status
+typedef int (*CompileFn)(const std::vector<std::string> &args);
+
+// A CompileServer keeps one compiler process running and handles
+// compile requests sent by clients (see forward_to_server) over a
+// Unix domain socket, so that build systems which invoke the compiler
+// many times don't pay process startup and cold-start costs for
+// every file.
+//
+// A request consists of the client's working directory and command
+// line arguments, along with the client's stdout and stderr file
+// descriptors (passed using SCM_RIGHTS). While the request is being
+// handled, the server's stdout and stderr are redirected to the
+// client's, so output and diagnostics are streamed directly to the
+// client as they are produced. When the compilation finishes, the
+// exit status is sent back to the client.
+//
+// Requests are handled one at a time, since the working directory
+// and the standard file descriptors are per-process state.
+class CompileServer {
+private:
+  std::string m_socket_path;
+  CompileFn m_compile_fn;
+  int m_listen_fd;
+
+  // value semantics prohibited
+  CompileServer(const CompileServer &);
+  CompileServer &operator=(const CompileServer &);
+
+public:
+  CompileServer(const std::string &socket_path, CompileFn compile_fn);
+  ~CompileServer();
+
+  // Accept and handle requests (does not return unless
+  // an error occurs)
+  void run();
+
+private:
+  void handle_request(int conn_fd);
+  int run_compile_in(const std::string &cwd, const std::vector<std::string> &args, int out_fd, int err_fd);
+};
+
+// Send a compile request to the server listening on the given
+// socket, and return the exit status of the compilation
+int forward_to_server(const std::string &socket_path, const std::vector<std::string> &args);
+
+#endif // COMPILE_SERVER_H
@@ -28,14 +28,27 @@
 #include "parse.tab.h"
 #include "lex.yy.h"
 #include "parser_state.h"
+#include "direct_lexer.h"
 #include "semantic_analysis.h"
+#include "interface.h"
+#include "profile.h"
+#include "ast_stats.h"
+#include "diagnostics.h"
+#include "ast_export.h"
 #include "context.h"
 
 Context::Context()
-  : m_ast(nullptr) {
+  : m_ast(nullptr)
+  , m_sema(new SemanticAnalysis())
+  , m_stats(nullptr)
+  , m_diags(nullptr)
+  , m_exporter(nullptr)
+  , m_lexer_kind(LexerKind::FLEX)
+  , m_jobs(1) {
 }
 
 Context::~Context() {
+  delete m_sema;
   delete m_ast;
 }
 
@@ -50,7 +63,7 @@ struct CloseFile {
 namespace {
 
 template<typename Fn>
-void process_source_file(const std::string &filename, Fn fn) {
+void process_source_file(const std::string &filename, LexerKind lexer_kind, Fn fn) {
   // open the input source file
   std::unique_ptr<FILE, CloseFile> in(fopen(filename.c_str(), "r"));
   if (!in) {
@@ -63,11 +76,18 @@ void process_source_file(const std::string &filename, Fn fn) {
   pp->cur_loc = Location(filename, 1, 1);
 
   // prepare the lexer
-  yylex_init(&pp->scan_info);
-  yyset_in(in.get(), pp->scan_info);
+  std::unique_ptr<DirectLexer> direct_lexer;
+  if (lexer_kind == LexerKind::DIRECT) {
+    direct_lexer.reset(new DirectLexer(pp->cur_loc));
+    direct_lexer->read_input(in.get());
+    pp->direct_lexer = direct_lexer.get();
+  } else {
+    yylex_init(&pp->scan_info);
+    yyset_in(in.get(), pp->scan_info);
 
-  // make the ParserState available from the lexer state
-  yyset_extra(pp.get(), pp->scan_info);
+    // make the ParserState available from the lexer state
+    yyset_extra(pp.get(), pp->scan_info);
+  }
 
   // use the ParserState to either scan tokens or parse the input
   // to build an AST
@@ -76,32 +96,83 @@ void process_source_file(const std::string &filename, Fn fn) {
 
 }
 
+int lex_token(YYSTYPE *semantic_value, ParserState *pp) {
+  if (pp->direct_lexer != nullptr)
+    return pp->direct_lexer->lex(semantic_value, pp);
+  return yylex(semantic_value, pp->scan_info);
+}
+
+TokenSink::TokenSink() {
+}
+
+TokenSink::~TokenSink() {
+}
+
+namespace {
+
+// TokenSink which keeps all of the tokens in a vector
+class CollectTokens : public TokenSink {
+private:
+  std::vector<Node *> &m_tokens;
+
+public:
+  CollectTokens(std::vector<Node *> &tokens) : m_tokens(tokens) { }
+
+  virtual void token(Node *tok) {
+    m_tokens.push_back(tok);
+  }
+};
+
+}
+
 void Context::scan_tokens(const std::string &filename, std::vector<Node *> &tokens) {
+  CollectTokens collect(tokens);
+  scan_tokens(filename, collect);
+}
+
+void Context::scan_tokens(const std::string &filename, TokenSink &sink) {
+  ScopedTimer timer("lex");
+
   auto callback = [&](ParserState *pp) {
     YYSTYPE yylval;
 
-    // the lexer will store pointers to all of the allocated
-    // token objects in the ParserState, so all we need to do
-    // is call yylex() until we reach the end of the input
-    while (yylex(&yylval, pp->scan_info) != 0)
-      ;
+    // the lexer stores a pointer to each token object it creates
+    // in the ParserState: hand each one over to the sink as soon
+    // as it is scanned, so that the ParserState doesn't retain it
+    while (lex_token(&yylval, pp) != 0) {
+      Node *tok = pp->tokens.back();
+      pp->tokens.clear();
+      sink.token(tok);
+    }
 
-    std::copy(pp->tokens.begin(), pp->tokens.end(), std::back_inserter(tokens));
+    if (pp->scan_info != nullptr)
+      yylex_destroy(pp->scan_info);
   };
 
-  process_source_file(filename, callback);
+  process_source_file(filename, m_lexer_kind, callback);
 }
 
 void Context::parse(const std::string &filename) {
+  parse(filename, std::function<void(Node *)>());
+}
+
+void Context::parse(const std::string &filename, const std::function<void(Node *)> &top_level_handler) {
+  ScopedTimer timer("parse");
+
   auto callback = [&](ParserState *pp) {
+    pp->top_level_handler = top_level_handler;
+
     // parse the input source code
     yyparse(pp);
 
     // free memory allocated by flex
-    yylex_destroy(pp->scan_info);
+    if (pp->scan_info != nullptr)
+      yylex_destroy(pp->scan_info);
 
     m_ast = pp->parse_tree;
 
+    ScopedTimer cleanup_timer("cleanup");
+
     // delete any Nodes that were created by the lexer,
     // but weren't incorporated into the parse tree
     std::set<Node *> tree_nodes;
@@ -113,16 +184,86 @@ void Context::parse(const std::string &filename) {
     }
   };
 
-  process_source_file(filename, callback);
+  process_source_file(filename, m_lexer_kind, callback);
 }
 
 void Context::analyze() {
   assert(m_ast != nullptr);
 
-  SemanticAnalysis sema;
-  sema.visit(m_ast);
+  {
+    ScopedTimer timer("analyze");
+    m_sema->analyze_unit(m_ast, m_jobs);
+  }
+
+  if (m_stats != nullptr) {
+    ScopedTimer timer("stats");
+    m_stats->record_scope(m_sema->get_global_symtab());
+    m_stats->collect_tree(m_ast);
+  }
+
+  if (m_exporter != nullptr) {
+    ScopedTimer timer("export_ast");
+    for (auto i = m_ast->cbegin(); i != m_ast->cend(); ++i)
+      m_exporter->write_declaration(*i);
+  }
+}
+
+void Context::analyze_stream(const std::string &filename) {
+  unsigned long num_decls = 0;
+  auto handler = [this, &num_decls](Node *decl) {
+    std::unique_ptr<Node> owned(decl);
+    ++num_decls;
+    // the rest of the input is only parsed once
+    // the error limit has been reached (but it is still
+    // exported, as it is by analyze())
+    if (m_diags == nullptr || !m_diags->limit_reached()) {
+      {
+        ScopedTimer timer("analyze");
+        m_sema->visit(decl);
+      }
+      if (m_stats != nullptr) {
+        ScopedTimer timer("stats");
+        m_stats->collect_tree(decl, 2);
+      }
+    }
+    if (m_exporter != nullptr) {
+      ScopedTimer timer("export_ast");
+      m_exporter->write_declaration(decl);
+    }
+  };
+
+  parse(filename, handler);
+
+  if (m_stats != nullptr) {
+    ScopedTimer timer("stats");
+    m_stats->record_scope(m_sema->get_global_symtab());
+    m_stats->collect_streamed_unit(m_ast, num_decls);
+  }
+}
+
+void Context::set_stats(ASTStats *stats) {
+  m_stats = stats;
+  m_sema->set_stats(stats);
+  m_sema->get_global_symtab()->set_print_entries(false);
+}
+
+void Context::set_diagnostics(Diagnostics *diags) {
+  m_diags = diags;
+  m_sema->set_diagnostics(diags);
 }
 
 void Context::print_symbol_table() {
   // TODO
 }
+
+void Context::import_interface(const std::string &filename) {
+  ScopedTimer timer("import");
+  InterfaceReader reader;
+  reader.read(filename, m_sema->get_global_symtab());
+}
+
+void Context::export_interface(const std::string &filename) {
+  ScopedTimer timer("export");
+  InterfaceWriter writer;
+  writer.write(m_sema->get_global_symtab(), filename);
+}
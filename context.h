@@ -23,26 +23,73 @@
 
 #include <vector>
 #include <string>
+#include <functional>
 class Node;
+class SemanticAnalysis;
+class ASTStats;
+class Diagnostics;
+class ASTExporter;
+
+// Which lexer to use to scan the input
+enum class LexerKind {
+  FLEX,    // scanner generated by flex from lex.l
+  DIRECT,  // hand-written DirectLexer
+};
+
+// Receives tokens from Context::scan_tokens as they are scanned.
+// The sink takes ownership of each token Node.
+class TokenSink {
+private:
+  // value semantics prohibited
+  TokenSink(const TokenSink &);
+  TokenSink &operator=(const TokenSink &);
+
+public:
+  TokenSink();
+  virtual ~TokenSink();
+
+  virtual void token(Node *tok) = 0;
+};
 
 // The Context class gathers together all of the objects/data
 // used in the compilation process, and orchestrates the various
-// passes and transformations.
+// passes and transformations. Each pass should be wrapped in a
+// ScopedTimer (see profile.h) so that it shows up in time reports.
 class Context {
 private:
   Node *m_ast;
+  SemanticAnalysis *m_sema;
+  ASTStats *m_stats;
+  Diagnostics *m_diags;
+  ASTExporter *m_exporter;
+  LexerKind m_lexer_kind;
+  unsigned m_jobs;
 
   // copy ctor and assignment operator not allowed
   Context(const Context &);
   Context &operator=(const Context &);
 
+  void parse(const std::string &filename, const std::function<void(Node *)> &top_level_handler);
+
 public:
   Context();
   ~Context();
 
+  // choose which lexer to use (the default is the flex scanner)
+  void set_lexer(LexerKind kind) { m_lexer_kind = kind; }
+
+  // set the number of threads used to analyze function bodies
+  // in analyze() (the default is 1)
+  void set_jobs(unsigned jobs) { m_jobs = jobs; }
+
   // scan the input and store the resulting tokens in a vector
   void scan_tokens(const std::string &filename, std::vector<Node *> &tokens);
 
+  // scan the input, passing each token to the sink as it is
+  // scanned (no tokens are retained, so memory use doesn't
+  // depend on the size of the input)
+  void scan_tokens(const std::string &filename, TokenSink &sink);
+
   // Parse an input file and build an AST
   void parse(const std::string &filename);
 
@@ -51,7 +98,36 @@ public:
 
   // TODO: add member functions for semantic analysis, code generation, etc.
   void analyze();
+
+  // Parse the input, analyzing each top-level declaration as soon
+  // as it has been parsed and then deleting it, so that memory use
+  // depends on the size of the largest declaration rather than the
+  // size of the input. This is an alternative to calling parse()
+  // and analyze(): the AST is not retained.
+  void analyze_stream(const std::string &filename);
   void print_symbol_table();
+
+  // Gather statistics about the AST and symbol tables in the
+  // given object during analyze(), rather than printing symbol
+  // table entries (must be called before analyze())
+  void set_stats(ASTStats *stats);
+
+  // Record semantic errors in the given object, rather than
+  // stopping at the first one (must be called before analyze());
+  // check it for errors after analyze()
+  void set_diagnostics(Diagnostics *diags);
+
+  // Write each top-level declaration to the given exporter once
+  // it has been analyzed (must be called before analyze())
+  void set_ast_exporter(ASTExporter *exporter) { m_exporter = exporter; }
+
+  // Add the symbols saved in an interface file to the global scope
+  // (must be done before analyze() is called)
+  void import_interface(const std::string &filename);
+
+  // Save the global symbol table to an interface file
+  // (must be done after analyze() is called)
+  void export_interface(const std::string &filename);
 };
 
 #endif // CONTEXT_H
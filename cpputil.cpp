@@ -43,3 +43,39 @@ std::string cpputil::vformat(const char *fmt, va_list args) {
 
   return std::string(buf);
 }
+
+size_t cpputil::utf8_sequence_length(const char *s, size_t len) {
+  const unsigned char *p = (const unsigned char *) s;
+  size_t n;
+  unsigned char lo = 0x80, hi = 0xBF;   // range of the second byte
+  if (p[0] >= 0xC2 && p[0] <= 0xDF) {
+    n = 2;
+  } else if (p[0] >= 0xE0 && p[0] <= 0xEF) {
+    n = 3;
+    if (p[0] == 0xE0)
+      lo = 0xA0;   // overlong
+    else if (p[0] == 0xED)
+      hi = 0x9F;   // surrogates
+  } else if (p[0] >= 0xF0 && p[0] <= 0xF4) {
+    n = 4;
+    if (p[0] == 0xF0)
+      lo = 0x90;   // overlong
+    else if (p[0] == 0xF4)
+      hi = 0x8F;   // beyond U+10FFFF
+  } else {
+    return 0;
+  }
+  if (len < n || p[1] < lo || p[1] > hi)
+    return 0;
+  for (size_t i = 2; i < n; ++i) {
+    if (p[i] < 0x80 || p[i] > 0xBF)
+      return 0;
+  }
+  return n;
+}
+
+std::string cpputil::json_escape(const std::string &s) {
+  std::string result;
+  append_json_escaped(result, s.data(), s.size());
+  return result;
+}
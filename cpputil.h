@@ -23,6 +23,7 @@
 
 // Utility functions for C++ code
 
+#include <cstddef>
 #include <string>
 
 namespace cpputil {
@@ -35,6 +36,56 @@ std::string format(const char *fmt, ...)
 
 std::string vformat(const char *fmt, va_list args);
 
+// the length of the valid UTF-8 sequence at the start of s
+// (which starts with a byte >= 0x80), or 0 if it isn't valid
+size_t utf8_sequence_length(const char *s, size_t len);
+
+// Append the len bytes at s to out, escaped as the contents of a JSON
+// string (without the quotes). out may be any object with an
+// append(const char *, size_t) member function, such as a std::string
+// or an OutputBuffer. Bytes that aren't part of a valid UTF-8 sequence
+// are written as "\u00XX" escapes (i.e., as if they were Latin-1),
+// so the result is always valid JSON.
+template<typename Out>
+void append_json_escaped(Out &out, const char *s, size_t len) {
+  static const char HEX[] = "0123456789abcdef";
+
+  // runs of characters that don't need to be escaped
+  // are appended all at once
+  size_t start = 0;
+  for (size_t i = 0; i < len; ++i) {
+    unsigned char c = (unsigned char) s[i];
+    if (c >= 0x80) {
+      // valid UTF-8 sequences are copied as they are
+      size_t n = utf8_sequence_length(s + i, len - i);
+      if (n > 0) {
+        i += n - 1;
+        continue;
+      }
+    } else if (c >= 0x20 && c != '"' && c != '\\') {
+      continue;
+    }
+    out.append(s + start, i - start);
+    start = i + 1;
+    switch (c) {
+    case '"':  out.append("\\\"", 2); break;
+    case '\\': out.append("\\\\", 2); break;
+    case '\n': out.append("\\n", 2); break;
+    case '\t': out.append("\\t", 2); break;
+    case '\r': out.append("\\r", 2); break;
+    default:
+      {
+        char esc[6] = { '\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 0xF] };
+        out.append(esc, 6);
+      }
+    }
+  }
+  out.append(s + start, len - start);
+}
+
+// s escaped as the contents of a JSON string (see append_json_escaped())
+std::string json_escape(const std::string &s);
+
 }
 
 #endif // CPPUTIL_H
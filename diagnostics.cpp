@@ -0,0 +1,57 @@
+#include <cstdarg>
+#include "cpputil.h"
+#include "exceptions.h"
+#include "diagnostics.h"
+
+Diagnostics::Diagnostics(unsigned max_errors)
+  : m_max_errors(max_errors)
+  , m_fatal(false) {
+}
+
+Diagnostics::~Diagnostics() {
+}
+
+void Diagnostics::error(const Location &loc, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  verror(loc, fmt, args);
+  va_end(args);
+}
+
+void Diagnostics::verror(const Location &loc, const char *fmt, va_list args) {
+  if (limit_reached())
+    return;
+  add(loc, cpputil::vformat(fmt, args));
+}
+
+void Diagnostics::fatal(const BaseException &ex) {
+  m_fatal = true;
+  add(ex.get_loc(), ex.what());
+}
+
+void Diagnostics::append(const Diagnostics &other) {
+  for (auto i = other.m_errors.begin(); i != other.m_errors.end() && !limit_reached(); ++i)
+    m_errors.push_back(*i);
+}
+
+void Diagnostics::print(FILE *out) const {
+  for (auto i = m_errors.begin(); i != m_errors.end(); ++i) {
+    const Location &loc = i->loc;
+    if (loc.is_valid()) {
+      fprintf(out, "%s:%d:%d:Error: %s\n", loc.get_srcfile().c_str(), loc.get_line(), loc.get_col(), i->msg.c_str());
+    } else {
+      fprintf(out, "Error: %s\n", i->msg.c_str());
+    }
+  }
+
+  // let the user know that there may be more errors
+  if (!m_fatal && limit_reached())
+    fprintf(out, "Error: too many errors (the limit is %u), stopping\n", m_max_errors);
+}
+
+void Diagnostics::add(const Location &loc, const std::string &msg) {
+  Diagnostic diag;
+  diag.loc = loc;
+  diag.msg = msg;
+  m_errors.push_back(diag);
+}
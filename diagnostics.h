@@ -0,0 +1,75 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <cstdarg>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "location.h"
+class BaseException;
+
+// Collects the errors found during a compilation, so that they can
+// all be reported at once, rather than stopping at the first one.
+// Semantic analysis records an error and recovers (by giving the
+// offending node the error type), so recording an error doesn't
+// involve throwing an exception. Errors that end the compilation
+// (such as syntax errors) are still thrown, and are added here by
+// the code that catches them.
+//
+// At most max_errors errors are recorded (0 means no limit): once
+// the limit is reached, further errors are ignored, and analysis
+// stops at the end of the current top-level declaration.
+class Diagnostics {
+public:
+  struct Diagnostic {
+    Location loc;
+    std::string msg;
+  };
+
+  static const unsigned DEFAULT_MAX_ERRORS = 20;
+
+private:
+  std::vector<Diagnostic> m_errors;
+  unsigned m_max_errors;
+  bool m_fatal;
+
+  // value semantics prohibited
+  Diagnostics(const Diagnostics &);
+  Diagnostics &operator=(const Diagnostics &);
+
+public:
+  Diagnostics(unsigned max_errors = DEFAULT_MAX_ERRORS);
+  ~Diagnostics();
+
+  void set_max_errors(unsigned max_errors) { m_max_errors = max_errors; }
+  unsigned get_max_errors() const { return m_max_errors; }
+
+  // record an error (unless the limit has been reached)
+  void error(const Location &loc, const char *fmt, ...)
+#ifdef __GNUC__
+    __attribute__ ((format (printf, 3, 4)))
+#endif
+    ;
+  void verror(const Location &loc, const char *fmt, va_list args);
+
+  // record an error that ended the compilation (this is recorded
+  // even if the limit has been reached)
+  void fatal(const BaseException &ex);
+
+  // add the errors recorded by another Diagnostics object
+  // (unless the limit has been reached)
+  void append(const Diagnostics &other);
+
+  bool has_errors() const { return !m_errors.empty(); }
+  unsigned get_num_errors() const { return unsigned(m_errors.size()); }
+  const Diagnostic &get_error(unsigned index) const { return m_errors.at(index); }
+  bool limit_reached() const { return m_max_errors != 0 && m_errors.size() >= m_max_errors; }
+
+  // print the errors, one per line, in the order they were recorded
+  void print(FILE *out) const;
+
+private:
+  void add(const Location &loc, const std::string &msg);
+};
+
+#endif // DIAGNOSTICS_H
@@ -0,0 +1,391 @@
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "node.h"
+#include "parse.tab.h"
+#include "parser_state.h"
+#include "grammar_symbols.h"
+#include "exceptions.h"
+#include "profile.h"
+#include "direct_lexer.h"
+
+namespace {
+
+inline bool is_digit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+inline bool is_hex_digit(char c) {
+  return is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+inline bool is_ident_start(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+inline bool is_ident_char(char c) {
+  return is_ident_start(c) || is_digit(c);
+}
+
+inline bool is_int_suffix(char c) {
+  return c == 'U' || c == 'u' || c == 'L' || c == 'l';
+}
+
+inline bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+// The following functions search the input between p and end.
+// When SSE2 is available, they examine 16 bytes at a time,
+// finishing with a scalar loop for the last few bytes (so they
+// never read past the end of the input).
+
+// find the first occurrence of either a or b (or end if neither occurs)
+const char *find_either(const char *p, const char *end, char a, char b) {
+#ifdef __SSE2__
+  const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+  for (; end - p >= 16; p += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)));
+    if (mask != 0)
+      return p + __builtin_ctz(unsigned(mask));
+  }
+#endif
+  while (p != end && *p != a && *p != b)
+    ++p;
+  return p;
+}
+
+// find the end of a run of spaces, tabs, and carriage returns
+const char *skip_spaces(const char *p, const char *end) {
+#ifdef __SSE2__
+  const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), cr = _mm_set1_epi8('\r');
+  for (; end - p >= 16; p += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i is_ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+                                 _mm_cmpeq_epi8(chunk, cr));
+    int mask = _mm_movemask_epi8(is_ws) ^ 0xFFFF;
+    if (mask != 0)
+      return p + __builtin_ctz(unsigned(mask));
+  }
+#endif
+  while (p != end && is_space(*p))
+    ++p;
+  return p;
+}
+
+}
+
+DirectLexer::DirectLexer(Location &loc)
+  : m_pos(nullptr)
+  , m_end(nullptr)
+  , m_loc(loc) {
+  set_input("");
+}
+
+DirectLexer::~DirectLexer() {
+}
+
+void DirectLexer::read_input(FILE *in) {
+  std::string text;
+  char buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+    text.append(buf, n);
+  if (ferror(in)) {
+    RuntimeError::raise("Error reading input");
+  }
+  set_input(text);
+}
+
+void DirectLexer::set_input(const std::string &text) {
+  m_buf = text;
+  m_pos = m_buf.data();
+  m_end = m_pos + m_buf.size();
+}
+
+int DirectLexer::next(Token &tok) {
+  int tag = scan(tok);
+  m_pos += tok.len;
+  m_loc.advance(int(tok.len));
+  return tag;
+}
+
+int DirectLexer::lex(YYSTYPE *semantic_value, ParserState *pp) {
+  Token tok;
+  int tag = scan(tok);
+  if (tag == 0)
+    return 0;
+
+  Node *node = new Node(tag, std::string(tok.text, tok.len));
+  node->set_loc(m_loc);
+  semantic_value->node = node;
+
+  m_pos += tok.len;
+  m_loc.advance(int(tok.len));
+
+  // keep track of the Nodes created by the lexer
+  pp->tokens.push_back(node);
+  Profile::count(PROF_TOKENS);
+
+  return tag;
+}
+
+// Find the next token, skipping whitespace and comments. The token
+// itself is not consumed. Note that the buffer is always followed by
+// a NUL character (since it's a std::string), so looking one
+// character past the current one is always safe.
+int DirectLexer::scan(Token &tok) {
+  const char *p;
+
+  for (;;) {
+    p = m_pos;
+    tok.text = p;
+    tok.line = m_loc.get_line();
+    tok.col = m_loc.get_col();
+
+    if (p == m_end) {
+      tok.len = 0;
+      return tok.tag = 0;
+    }
+
+    char c = *p;
+    switch (c) {
+    case ' ': case '\t': case '\r':
+      {
+        const char *q = skip_spaces(p + 1, m_end);
+        m_loc.advance(int(q - p));
+        m_pos = q;
+      }
+      continue;
+
+    case '\n':
+      m_loc.next_line();
+      m_pos = p + 1;
+      continue;
+
+    case '/':
+      if (p[1] == '*') {
+        m_loc.advance(2);
+        m_pos = p + 2;
+        skip_block_comment();
+        continue;
+      }
+      if (p[1] == '/') {
+        // the comment must be terminated by a newline
+        const char *nl = static_cast<const char *>(memchr(p + 2, '\n', size_t(m_end - (p + 2))));
+        if (nl != nullptr) {
+          m_loc.next_line();
+          m_pos = nl + 1;
+          continue;
+        }
+        tok.len = 1;
+        return tok.tag = TOK_DIVIDE;
+      }
+      if (p[1] == '=') {
+        tok.len = 2;
+        return tok.tag = TOK_DIV_ASSIGN;
+      }
+      tok.len = 1;
+      return tok.tag = TOK_DIVIDE;
+
+    default:
+      break;
+    }
+
+    break;
+  }
+
+  char c = *p;
+  int tag;
+  unsigned len = 1;
+
+  if (is_ident_start(c)) {
+    const char *q = p + 1;
+    while (is_ident_char(*q))
+      ++q;
+    len = unsigned(q - p);
+    tag = lookup_keyword(p, len);
+    if (tag == 0)
+      tag = TOK_IDENT;
+  } else if (is_digit(c)) {
+    const char *q = p;
+    if (c == '0' && (p[1] == 'x' || p[1] == 'X') && is_hex_digit(p[2])) {
+      q = p + 3;
+      while (is_hex_digit(*q))
+        ++q;
+      while (is_int_suffix(*q))
+        ++q;
+      tag = TOK_INT_LIT;
+    } else {
+      while (is_digit(*q))
+        ++q;
+      if (*q == '.') {
+        ++q;
+        while (is_digit(*q))
+          ++q;
+        if (*q == 'F' || *q == 'f')
+          ++q;
+        tag = TOK_FP_LIT;
+      } else {
+        while (is_int_suffix(*q))
+          ++q;
+        tag = TOK_INT_LIT;
+      }
+    }
+    len = unsigned(q - p);
+  } else {
+    char c1 = p[1], c2 = (c1 != '\0') ? p[2] : '\0';
+    switch (c) {
+    case '(': tag = TOK_LPAREN; break;
+    case ')': tag = TOK_RPAREN; break;
+    case '[': tag = TOK_LBRACKET; break;
+    case ']': tag = TOK_RBRACKET; break;
+    case '{': tag = TOK_LBRACE; break;
+    case '}': tag = TOK_RBRACE; break;
+    case ';': tag = TOK_SEMICOLON; break;
+    case ':': tag = TOK_COLON; break;
+    case ',': tag = TOK_COMMA; break;
+    case '.': tag = TOK_DOT; break;
+    case '?': tag = TOK_QUESTION; break;
+    case '~': tag = TOK_BITWISE_COMPL; break;
+
+    case '!':
+      if (c1 == '=') { tag = TOK_INEQUALITY; len = 2; }
+      else tag = TOK_NOT;
+      break;
+
+    case '+':
+      if (c1 == '+') { tag = TOK_INCREMENT; len = 2; }
+      else if (c1 == '=') { tag = TOK_ADD_ASSIGN; len = 2; }
+      else tag = TOK_PLUS;
+      break;
+
+    case '-':
+      if (c1 == '-') { tag = TOK_DECREMENT; len = 2; }
+      else if (c1 == '=') { tag = TOK_SUB_ASSIGN; len = 2; }
+      else if (c1 == '>') { tag = TOK_ARROW; len = 2; }
+      else tag = TOK_MINUS;
+      break;
+
+    case '*':
+      if (c1 == '=') { tag = TOK_MUL_ASSIGN; len = 2; }
+      else tag = TOK_ASTERISK;
+      break;
+
+    case '%':
+      if (c1 == '=') { tag = TOK_MOD_ASSIGN; len = 2; }
+      else tag = TOK_MOD;
+      break;
+
+    case '&':
+      if (c1 == '&') { tag = TOK_LOGICAL_AND; len = 2; }
+      else if (c1 == '=') { tag = TOK_AND_ASSIGN; len = 2; }
+      else tag = TOK_AMPERSAND;
+      break;
+
+    case '|':
+      if (c1 == '|') { tag = TOK_LOGICAL_OR; len = 2; }
+      else if (c1 == '=') { tag = TOK_OR_ASSIGN; len = 2; }
+      else tag = TOK_BITWISE_OR;
+      break;
+
+    case '^':
+      if (c1 == '=') { tag = TOK_XOR_ASSIGN; len = 2; }
+      else tag = TOK_BITWISE_XOR;
+      break;
+
+    case '=':
+      if (c1 == '=') { tag = TOK_EQUALITY; len = 2; }
+      else tag = TOK_ASSIGN;
+      break;
+
+    case '<':
+      if (c1 == '<' && c2 == '=') { tag = TOK_LEFT_ASSIGN; len = 3; }
+      else if (c1 == '<') { tag = TOK_LEFT_SHIFT; len = 2; }
+      else if (c1 == '=') { tag = TOK_LTE; len = 2; }
+      else tag = TOK_LT;
+      break;
+
+    case '>':
+      if (c1 == '>' && c2 == '=') { tag = TOK_RIGHT_ASSIGN; len = 3; }
+      else if (c1 == '>') { tag = TOK_RIGHT_SHIFT; len = 2; }
+      else if (c1 == '=') { tag = TOK_GTE; len = 2; }
+      else tag = TOK_GT;
+      break;
+
+    case '"':
+      {
+        // A string literal may contain any character other than an
+        // unescaped quote or backslash (including newlines), and
+        // a backslash may escape any character other than a newline
+        const char *q = p + 1;
+        tag = 0;
+        while ((q = find_either(q, m_end, '"', '\\')) != m_end) {
+          if (*q == '"') {
+            tag = TOK_STR_LIT;
+            len = unsigned(q + 1 - p);
+            break;
+          }
+          if (q + 1 == m_end || q[1] == '\n')
+            break;
+          q += 2;
+        }
+      }
+      break;
+
+    case '\'':
+      // either an escaped character or a single character
+      // other than a backslash, quote, or newline
+      if (m_end - p >= 4 && c1 == '\\' && c2 != '\n' && p[3] == '\'') {
+        tag = TOK_CHAR_LIT;
+        len = 4;
+      } else if (m_end - p >= 3 && c1 != '\\' && c1 != '\'' && c1 != '\n' && c2 == '\'') {
+        tag = TOK_CHAR_LIT;
+        len = 3;
+      } else {
+        tag = 0;
+      }
+      break;
+
+    default:
+      tag = 0;
+      break;
+    }
+
+    if (tag == 0) {
+      SyntaxError::raise(m_loc, "Unrecognized character");
+    }
+  }
+
+  tok.len = len;
+  return tok.tag = tag;
+}
+
+// Skip the body of a block comment: the opening "/*" has already
+// been consumed. As with the flex scanner, reaching the end of the
+// input before the closing "*/" is not an error.
+void DirectLexer::skip_block_comment() {
+  const char *p = m_pos;
+  for (;;) {
+    // only asterisks and newlines are interesting
+    const char *q = find_either(p, m_end, '*', '\n');
+    m_loc.advance(int(q - p));
+    p = q;
+    if (p == m_end)
+      break;
+    if (*p == '\n') {
+      m_loc.next_line();
+      ++p;
+    } else if (p[1] == '/') {
+      m_loc.advance(2);
+      p += 2;
+      break;
+    } else {
+      m_loc.advance(1);
+      ++p;
+    }
+  }
+  m_pos = p;
+}
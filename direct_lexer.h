@@ -0,0 +1,71 @@
+#ifndef DIRECT_LEXER_H
+#define DIRECT_LEXER_H
+
+#include <cstdio>
+#include <string>
+#include "location.h"
+struct ParserState;
+union YYSTYPE;
+
+// A token found by the DirectLexer. The text of the token points
+// into the lexer's input buffer, so no memory is allocated
+// for the token.
+struct Token {
+  int tag;           // token tag (0 at end of input)
+  const char *text;  // lexeme (not NUL-terminated)
+  unsigned len;      // length of lexeme
+  int line, col;     // source location of the first character
+};
+
+// A hand-written lexer which recognizes exactly the same tokens
+// as the flex scanner in lex.l, and is an alternative to it.
+// The entire input is read into memory, and each token is recognized
+// by code which switches on its first character, so no state tables
+// or per-token memory allocation are needed. Keywords are scanned as
+// identifiers and recognized with lookup_keyword() (grammar_symbols.h).
+// (Nodes are still created for tokens passed to the parser, since
+// the parse tree is built out of them.)
+//
+// To match the flex scanner, including its quirks: a string literal
+// may span lines, but the column is advanced by the length of the
+// literal (as with any other token); an unterminated block comment
+// extends to the end of the input; a "//" comment must end with
+// a newline (otherwise the slashes are DIVIDE tokens); and any
+// other unexpected character is a syntax error.
+class DirectLexer {
+private:
+  std::string m_buf;
+  const char *m_pos, *m_end;
+  Location &m_loc;
+
+  // value semantics prohibited
+  DirectLexer(const DirectLexer &);
+  DirectLexer &operator=(const DirectLexer &);
+
+public:
+  // The lexer keeps the given Location up to date as it
+  // scans the input (in the same way as the flex scanner
+  // updates the ParserState's current location)
+  DirectLexer(Location &loc);
+  ~DirectLexer();
+
+  // read the entire input from the given file
+  void read_input(FILE *in);
+
+  // use the given string as the input
+  void set_input(const std::string &text);
+
+  // Get the next token, returning its tag (0 at end of input).
+  // Throws a SyntaxError for an unrecognized character.
+  int next(Token &tok);
+
+  // Get the next token for the parser, creating a Node for it
+  // (like create_token in lex.l)
+  int lex(YYSTYPE *semantic_value, ParserState *pp);
+
+private:
+  int scan(Token &tok);
+  void skip_block_comment();
+};
+
+#endif // DIRECT_LEXER_H
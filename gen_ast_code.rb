@@ -4,6 +4,7 @@
 #
 #   ast_visitor.h
 #   ast_visitor.cpp
+#   static_ast_visitor.h
 #   ast.cpp
 
 def visit_function_name(tag)
@@ -101,6 +102,126 @@ void ASTVisitor::visit_token(Node *n) {
 EOF6
 end
 
+def gen_static_ast_visitor_h(outf, ast_tags)
+  outf.print <<"EOF9"
+#ifndef STATIC_AST_VISITOR_H
+#define STATIC_AST_VISITOR_H
+
+#include <vector>
+#include <type_traits>
+#include "node.h"
+#include "exceptions.h"
+#include "ast.h"
+
+// A compile-time alternative to ASTVisitor: a pass derives from
+// StaticASTVisitor<PassClass> (the "curiously recurring template
+// pattern"), and defines (non-virtual) visit_XXX member functions
+// for the node types it handles. Calls to visit() are dispatched
+// directly to the derived class's member functions, without virtual
+// calls, so the compiler can inline them. The default visit_XXX
+// functions (one per tag) visit the node's children.
+//
+// Since it is known at compile time which visit_XXX functions the
+// derived class defines, visit_children() doesn't recurse through
+// the nodes handled by the default functions: their children are
+// put on an explicit stack instead. So, only the derived class's own
+// visit_XXX functions use the C++ stack.
+template<typename Derived>
+class StaticASTVisitor {
+private:
+  // nodes waiting to be visited by the active visit_children() calls
+  // (the first m_num_pending elements are used)
+  std::vector<Node *> m_pending;
+  size_t m_num_pending;
+
+  // true if the derived class uses the default visit_children()
+  static const bool DEFAULT_VISIT_CHILDREN =
+    std::is_same<decltype(&Derived::visit_children),
+                 decltype(&StaticASTVisitor::visit_children)>::value;
+
+protected:
+  Derived &derived() { return *static_cast<Derived *>(this); }
+
+public:
+  StaticASTVisitor() : m_num_pending(0) { }
+
+  void visit(Node *n) {
+    if (!dispatch(n))
+      visit_children(n);
+  }
+
+EOF9
+
+  ast_tags.each do |tag|
+    outf.puts "  void #{visit_function_name(tag)}(Node *n) { derived().visit_children(n); }"
+  end
+
+  outf.print <<"EOF10"
+
+  void visit_children(Node *n) {
+    // Only the nodes pushed by this call are visited here: a nested
+    // call (from one of the derived class's visit_XXX functions)
+    // leaves the nodes below its mark alone.
+    size_t mark = m_num_pending;
+    push_kids(n);
+    while (m_num_pending > mark) {
+      Node *kid = m_pending[--m_num_pending];
+      if (!dispatch(kid))
+        push_kids(kid);
+    }
+  }
+
+  void visit_token(Node *n) {
+    // default implementation does nothing
+  }
+
+private:
+  void push_kids(Node *n) {
+    unsigned num_kids = n->get_num_kids();
+    if (m_num_pending + num_kids > m_pending.size())
+      m_pending.resize(2 * (m_num_pending + num_kids));
+    // in reverse order, so that the children are visited in order
+    Node **base = m_pending.data();
+    for (unsigned i = num_kids; i > 0; --i)
+      base[m_num_pending++] = n->get_kid(i - 1);
+  }
+
+  // Call the derived class's visit_XXX function for the node and
+  // return true, or, if the derived class uses the default function
+  // (so that visiting the node just means visiting its children),
+  // return false without doing anything
+  bool dispatch(Node *n) {
+    // assume that any node with a tag value less than 1000
+    // is a token
+    if (n->get_tag() < 1000) {
+      derived().visit_token(n);
+      return true;
+    }
+
+    switch (n->get_tag()) {
+EOF10
+
+  ast_tags.each do |tag|
+    fn = visit_function_name(tag)
+    outf.puts "    case #{tag}:"
+    outf.puts "      if (DEFAULT_VISIT_CHILDREN && std::is_same<decltype(&Derived::#{fn}), decltype(&StaticASTVisitor::#{fn})>::value)"
+    outf.puts "        return false;"
+    outf.puts "      derived().#{fn}(n);"
+    outf.puts "      return true;"
+  end
+
+  outf.print <<"EOF11"
+    default:
+      RuntimeError::raise("Unknown AST node tag %d", n->get_tag());
+      return true;
+    }
+  }
+};
+
+#endif // STATIC_AST_VISITOR_H
+EOF11
+end
+
 def gen_ast_cpp(outf, ast_tags)
   outf.print <<"EOF7"
 #include <cassert>
@@ -150,6 +271,10 @@ File.open('ast_visitor.cpp', 'w') do |outf|
   gen_ast_visitor_cpp(outf, ast_tags)
 end
 
+File.open('static_ast_visitor.h', 'w') do |outf|
+  gen_static_ast_visitor_h(outf, ast_tags)
+end
+
 File.open('ast.cpp', 'w') do |outf|
   gen_ast_cpp(outf, ast_tags)
 end
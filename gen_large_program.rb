@@ -0,0 +1,192 @@
+#! /usr/bin/env ruby
+
+# Generate a large synthetic C program for scaling tests and benchmarks
+# (see bench.cpp). The output uses only the subset of C accepted by
+# the parser and semantic analysis, and is deterministic for a given
+# seed and set of shape parameters, so that benchmark results
+# can be compared across runs.
+#
+# Usage: ./gen_large_program.rb [options...] > program.c
+#
+# Options (defaults in parentheses):
+#
+#   --seed=N             random seed (1)
+#   --lines=N            approximate number of lines to generate; if
+#                        specified, the number of functions is chosen
+#                        to produce (roughly) this many lines
+#   --functions=N        number of functions (10)
+#   --statements=N       statements per function (50)
+#   --struct-members=N   members in the generated struct (10, at least 1)
+#   --globals=N          number of global variables (10)
+#   --nesting=N          depth of nested blocks in each function (3);
+#                        statements in the innermost block refer to
+#                        globals, so each lookup walks the whole scope chain
+#   --expr-size=N        operands per expression (4)
+#
+# Shapes of interest:
+#
+#   long files:          --lines=100000
+#   huge structs:        --struct-members=10000
+#   deep scopes:         --functions=1 --nesting=1000
+#   long functions:      --functions=1 --statements=50000
+#   huge expressions:    --functions=1 --statements=1 --expr-size=100000
+
+BINARY_OPS = [ '+', '-', '*', '&', '|', '^' ]
+COMPARE_OPS = [ '<', '<=', '>', '>=', '==', '!=' ]
+
+$opts = {
+  'seed' => 1,
+  'lines' => nil,
+  'functions' => 10,
+  'statements' => 50,
+  'struct-members' => 10,
+  'globals' => 10,
+  'nesting' => 3,
+  'expr-size' => 4,
+}
+
+ARGV.each do |arg|
+  if (m = /^--([a-z-]+)=(\d+)$/.match(arg)) && $opts.has_key?(m[1])
+    $opts[m[1]] = m[2].to_i
+  else
+    STDERR.puts "Unknown option: #{arg}"
+    STDERR.puts "Usage: ./gen_large_program.rb [options...] > program.c"
+    exit 1
+  end
+end
+
+# the generated statements assign to randomly chosen struct members
+if $opts['struct-members'] < 1
+  STDERR.puts "--struct-members must be at least 1"
+  exit 1
+end
+
+$rand = Random.new($opts['seed'])
+
+def pick(list)
+  return list[$rand.rand(list.size)]
+end
+
+# Generate an integer expression with the given number of operands,
+# chosen from the given variable names and small integer literals.
+# The expression is a flat chain of binary operators, so its parse
+# tree gets deeper as the expression gets longer.
+def gen_expr(vars, size)
+  operand = lambda do
+    $rand.rand(4) == 0 ? $rand.rand(100).to_s : pick(vars)
+  end
+  parts = [ operand.call ]
+  (size - 1).times do
+    parts << pick(BINARY_OPS)
+    parts << operand.call
+  end
+  return parts.join(' ')
+end
+
+# Generate one statement at the given indentation level
+def gen_stmt(out, indent, vars, callees)
+  pad = '  ' * indent
+  case $rand.rand(10)
+  when 0
+    out.puts "#{pad}if (#{pick(vars)} #{pick(COMPARE_OPS)} #{gen_expr(vars, 2)}) {"
+    out.puts "#{pad}  #{pick(vars)} = #{gen_expr(vars, $opts['expr-size'])};"
+    out.puts "#{pad}} else {"
+    out.puts "#{pad}  #{pick(vars)} = #{gen_expr(vars, $opts['expr-size'])};"
+    out.puts "#{pad}}"
+  when 1
+    out.puts "#{pad}while (#{pick(vars)} < #{$rand.rand(100)}) {"
+    out.puts "#{pad}  #{pick(vars)} = #{gen_expr(vars, $opts['expr-size'])};"
+    out.puts "#{pad}}"
+  when 2
+    if callees.empty?
+      out.puts "#{pad}#{pick(vars)} = #{gen_expr(vars, $opts['expr-size'])};"
+    else
+      out.puts "#{pad}#{pick(vars)} = #{pick(callees)}(#{pick(vars)}, #{gen_expr(vars, 2)});"
+    end
+  when 3
+    out.puts "#{pad}rec.m#{$rand.rand($opts['struct-members'])} = #{gen_expr(vars, $opts['expr-size'])};"
+  else
+    out.puts "#{pad}#{pick(vars)} = #{gen_expr(vars, $opts['expr-size'])};"
+  end
+end
+
+def gen_function(out, index, globals, callees)
+  name = "fn#{index}"
+  out.puts "int #{name}(int a, int b) {"
+  out.puts "  int x, y, z;"
+  out.puts "  struct Record rec;"
+  out.puts "  x = a;"
+  out.puts "  y = b;"
+  out.puts "  z = 0;"
+  locals = [ 'a', 'b', 'x', 'y', 'z' ]
+
+  # Nested blocks: each one declares a new variable, and the
+  # statements are distributed over the levels of nesting
+  nesting = $opts['nesting']
+  num_stmts = $opts['statements']
+  per_level = num_stmts / (nesting + 1)
+  emitted = 0
+  vars = locals.dup
+  (0..nesting).each do |level|
+    indent = level + 1
+    if level > 0
+      out.puts "#{'  ' * (indent - 1)}{"
+      out.puts "#{'  ' * indent}int n#{level};"
+      out.puts "#{'  ' * indent}n#{level} = #{pick(vars)};"
+      vars = [ "n#{level}" ] + locals
+    end
+    count = (level == nesting) ? num_stmts - emitted : per_level
+    # in the innermost block, also refer to globals
+    stmt_vars = (level == nesting) ? vars + globals : vars
+    count.times { gen_stmt(out, indent, stmt_vars, callees) }
+    emitted += count
+  end
+  nesting.downto(1) do |level|
+    out.puts "#{'  ' * level}}"
+  end
+
+  out.puts "  return x + y + z;"
+  out.puts "}"
+  out.puts ""
+  return name
+end
+
+out = STDOUT
+
+out.puts "/* generated by gen_large_program.rb #{ARGV.join(' ')} */"
+out.puts ""
+
+out.puts "struct Record {"
+$opts['struct-members'].times do |i|
+  out.puts "  int m#{i};"
+end
+out.puts "};"
+out.puts ""
+
+globals = []
+$opts['globals'].times do |i|
+  globals << "g#{i}"
+  out.puts "int g#{i};"
+end
+out.puts ""
+
+# Estimate the number of lines per function, so that --lines
+# can be translated into a number of functions
+num_functions = $opts['functions']
+if !$opts['lines'].nil?
+  # about 1.5 lines per statement (some statements are compound),
+  # plus the function header/footer and a few lines per nested block
+  per_function = ($opts['statements'] * 3) / 2 + 9 + 3 * $opts['nesting']
+  header = $opts['struct-members'] + $opts['globals'] + 6
+  num_functions = [ ($opts['lines'] - header) / per_function, 1 ].max
+end
+
+# Each function may call any of the functions defined before it
+callees = []
+num_functions.times do |i|
+  callees << gen_function(out, i, globals, callees)
+end
+
+out.puts "int main(void) {"
+out.puts "  return #{callees.empty? ? '0' : "#{callees.last}(1, 2)"};"
+out.puts "}"
@@ -0,0 +1,368 @@
+#include <cassert>
+#include <cstdio>
+#include <memory>
+#include "exceptions.h"
+#include "interface.h"
+
+namespace {
+
+const char MAGIC[] = "NCCI";
+const unsigned MAGIC_LEN = 4;
+const unsigned FORMAT_VERSION = 1;
+
+struct CloseFile {
+  void operator()(FILE *f) {
+    if (f != nullptr) {
+      fclose(f);
+    }
+  }
+};
+
+}
+
+////////////////////////////////////////////////////////////////////////
+// InterfaceWriter implementation
+////////////////////////////////////////////////////////////////////////
+
+InterfaceWriter::InterfaceWriter()
+  : m_num_types(0) {
+}
+
+InterfaceWriter::~InterfaceWriter() {
+}
+
+void InterfaceWriter::write(const SymbolTable *symtab, const std::string &filename) {
+  m_buf.assign(MAGIC, MAGIC_LEN);
+  put_uint(FORMAT_VERSION);
+
+  for (auto i = symtab->cbegin(); i != symtab->cend(); ++i) {
+    Symbol *sym = *i;
+    unsigned type_id = encode_type(sym->get_type());
+
+    // A function defined in this translation unit is only
+    // *declared* as far as an importing translation unit is concerned
+    bool is_defined = sym->is_defined() && sym->get_kind() != SymbolKind::FUNCTION;
+
+    put_uint(IREC_SYMBOL);
+    put_uint(unsigned(sym->get_kind()));
+    put_str(sym->get_name());
+    put_uint(type_id);
+    put_uint(is_defined);
+  }
+  put_uint(IREC_END);
+
+  std::unique_ptr<FILE, CloseFile> out(fopen(filename.c_str(), "wb"));
+  if (!out || fwrite(m_buf.data(), 1, m_buf.size(), out.get()) != m_buf.size()) {
+    RuntimeError::raise("Couldn't write interface file '%s'", filename.c_str());
+  }
+}
+
+// Make sure that a record describing the given type has been written,
+// and return its type number. Types are identified by object identity,
+// so parts of type representations that are shared in memory are
+// also shared in the interface file.
+unsigned InterfaceWriter::encode_type(const std::shared_ptr<Type> &type) {
+  auto i = m_type_ids.find(type.get());
+  if (i != m_type_ids.end())
+    return i->second;
+
+  if (type->get_unqualified_type() != type.get()) {
+    // QualifiedType: note that this check must come first, since
+    // a QualifiedType has the kind of its delegate
+    unsigned delegate_id = encode_type(type->get_base_type());
+    put_uint(IREC_QUALIFIED_TYPE);
+    put_uint(delegate_id);
+    put_uint(unsigned(type->is_const() ? TypeQualifier::CONST : TypeQualifier::VOLATILE));
+  } else if (type->is_basic()) {
+    put_uint(IREC_BASIC_TYPE);
+    put_uint(unsigned(type->get_basic_type_kind()));
+    put_uint(type->is_signed());
+    put_uint(type->is_lvalue());
+  } else if (type->is_struct()) {
+    // the struct is numbered before its members are written,
+    // so that members can refer to it
+    const StructType *struct_type = dynamic_cast<const StructType *>(type.get());
+    assert(struct_type != nullptr);
+    put_uint(IREC_STRUCT_TYPE);
+    put_str(struct_type->get_name());
+    unsigned id = m_num_types++;
+    m_type_ids[type.get()] = id;
+    encode_members(type.get());
+    return id;
+  } else if (type->is_pointer()) {
+    unsigned base_id = encode_type(type->get_base_type());
+    put_uint(IREC_POINTER_TYPE);
+    put_uint(base_id);
+  } else if (type->is_array()) {
+    unsigned base_id = encode_type(type->get_base_type());
+    put_uint(IREC_ARRAY_TYPE);
+    put_uint(base_id);
+    put_uint(type->get_array_size());
+  } else if (type->is_function()) {
+    unsigned base_id = encode_type(type->get_base_type());
+    std::vector<unsigned> param_ids;
+    for (unsigned j = 0; j < type->get_num_members(); ++j) {
+      param_ids.push_back(encode_type(type->get_member(j).get_type()));
+    }
+    put_uint(IREC_FUNCTION_TYPE);
+    put_uint(base_id);
+    put_uint(param_ids.size());
+    for (unsigned j = 0; j < type->get_num_members(); ++j) {
+      put_str(type->get_member(j).get_name());
+      put_uint(param_ids[j]);
+    }
+  } else {
+    RuntimeError::raise("Can't write type '%s' to interface file", type->as_str().c_str());
+  }
+
+  unsigned id = m_num_types++;
+  m_type_ids[type.get()] = id;
+  return id;
+}
+
+void InterfaceWriter::encode_members(const Type *type) {
+  std::vector<unsigned> member_ids;
+  for (unsigned j = 0; j < type->get_num_members(); ++j) {
+    member_ids.push_back(encode_type(type->get_member(j).get_type()));
+  }
+
+  put_uint(IREC_STRUCT_MEMBERS);
+  put_uint(m_type_ids[type]);
+  put_uint(member_ids.size());
+  for (unsigned j = 0; j < type->get_num_members(); ++j) {
+    put_str(type->get_member(j).get_name());
+    put_uint(member_ids[j]);
+  }
+}
+
+void InterfaceWriter::put_uint(uint64_t val) {
+  do {
+    unsigned char byte = val & 0x7F;
+    val >>= 7;
+    if (val != 0)
+      byte |= 0x80;
+    m_buf.push_back(char(byte));
+  } while (val != 0);
+}
+
+void InterfaceWriter::put_str(const std::string &s) {
+  put_uint(s.size());
+  m_buf.append(s);
+}
+
+////////////////////////////////////////////////////////////////////////
+// InterfaceReader implementation
+////////////////////////////////////////////////////////////////////////
+
+InterfaceReader::InterfaceReader()
+  : m_pos(0) {
+}
+
+InterfaceReader::~InterfaceReader() {
+}
+
+void InterfaceReader::read(const std::string &filename, SymbolTable *symtab) {
+  m_filename = filename;
+
+  std::unique_ptr<FILE, CloseFile> in(fopen(filename.c_str(), "rb"));
+  if (!in) {
+    RuntimeError::raise("Couldn't open interface file '%s'", filename.c_str());
+  }
+  char chunk[65536];
+  size_t n;
+  m_buf.clear();
+  while ((n = fread(chunk, 1, sizeof(chunk), in.get())) > 0) {
+    m_buf.append(chunk, n);
+  }
+
+  m_pos = 0;
+  m_types.clear();
+  m_existing_structs.clear();
+  if (m_buf.compare(0, MAGIC_LEN, MAGIC) != 0) {
+    corrupt();
+  }
+  m_pos = MAGIC_LEN;
+  if (get_uint() != FORMAT_VERSION) {
+    RuntimeError::raise("Interface file '%s' has an unsupported format version", filename.c_str());
+  }
+
+  // imported symbols were already reported when the interface
+  // file was created
+  bool print_entries = symtab->get_print_entries();
+  symtab->set_print_entries(false);
+
+  try {
+    for (;;) {
+      uint64_t rec = get_uint();
+      std::shared_ptr<Type> type;
+
+      switch (rec) {
+      case IREC_END:
+        symtab->set_print_entries(print_entries);
+        return;
+
+      case IREC_BASIC_TYPE:
+        {
+          uint64_t kind = get_uint();
+          if (kind > uint64_t(BasicTypeKind::VOID))
+            corrupt();
+          bool is_signed = get_uint() != 0;
+          bool is_lvalue = get_uint() != 0;
+          type.reset(new BasicType(BasicTypeKind(kind), is_signed));
+          type->set_is_lvalue(is_lvalue);
+        }
+        break;
+
+      case IREC_QUALIFIED_TYPE:
+        {
+          std::shared_ptr<Type> delegate = get_type_ref();
+          uint64_t qual = get_uint();
+          if (qual != uint64_t(TypeQualifier::CONST) && qual != uint64_t(TypeQualifier::VOLATILE))
+            corrupt();
+          type.reset(new QualifiedType(delegate, TypeQualifier(qual)));
+        }
+        break;
+
+      case IREC_POINTER_TYPE:
+        type.reset(new PointerType(get_type_ref()));
+        break;
+
+      case IREC_ARRAY_TYPE:
+        {
+          std::shared_ptr<Type> base_type = get_type_ref();
+          type.reset(new ArrayType(base_type, unsigned(get_uint())));
+        }
+        break;
+
+      case IREC_FUNCTION_TYPE:
+        type.reset(new FunctionType(get_type_ref()));
+        read_members(type);
+        break;
+
+      case IREC_STRUCT_TYPE:
+        {
+          // If the struct type is already known (e.g., because it was
+          // imported from another interface file), use the existing
+          // type object, so there is only one representation of the type
+          std::string name = get_str();
+          Symbol *existing = symtab->lookup_local("struct " + name);
+          if (existing != nullptr && existing->get_kind() == SymbolKind::TYPE) {
+            type = existing->get_type();
+            m_existing_structs.insert(type.get());
+          } else {
+            type.reset(new StructType(name));
+          }
+        }
+        break;
+
+      case IREC_STRUCT_MEMBERS:
+        {
+          std::shared_ptr<Type> struct_type = get_type_ref();
+          if (!struct_type->is_struct())
+            corrupt();
+          if (m_existing_structs.count(struct_type.get()) > 0) {
+            // members were already added, but must agree
+            // (in number, and in each member's name and type)
+            std::shared_ptr<Type> check(new StructType(""));
+            read_members(check);
+            bool same = check->get_num_members() == struct_type->get_num_members();
+            for (unsigned i = 0; same && i < check->get_num_members(); ++i) {
+              const Member &left = check->get_member(i);
+              const Member &right = struct_type->get_member(i);
+              same = left.get_name() == right.get_name()
+                && left.get_type()->is_same(right.get_type().get());
+            }
+            if (!same)
+              RuntimeError::raise("Interface file '%s' has a conflicting definition of '%s'",
+                                  m_filename.c_str(), struct_type->as_str().c_str());
+          } else {
+            if (struct_type->get_num_members() != 0)
+              corrupt();
+            read_members(struct_type);
+          }
+        }
+        break;
+
+      case IREC_SYMBOL:
+        import_symbol(symtab);
+        break;
+
+      default:
+        corrupt();
+      }
+
+      if (type)
+        m_types.push_back(type);
+    }
+  } catch (...) {
+    symtab->set_print_entries(print_entries);
+    throw;
+  }
+}
+
+void InterfaceReader::import_symbol(SymbolTable *symtab) {
+  uint64_t kind = get_uint();
+  if (kind > uint64_t(SymbolKind::TYPE))
+    corrupt();
+  std::string name = get_str();
+  std::shared_ptr<Type> type = get_type_ref();
+  bool is_defined = get_uint() != 0;
+
+  Symbol *existing = symtab->lookup_local(name);
+  if (existing != nullptr) {
+    // the same declaration may reach us through more than one
+    // interface file, which is fine as long as they agree
+    if (existing->get_kind() != SymbolKind(kind) || !existing->get_type()->is_same(type.get())) {
+      RuntimeError::raise("Interface file '%s' has a conflicting declaration of '%s'",
+                          m_filename.c_str(), name.c_str());
+    }
+    return;
+  }
+
+  if (is_defined)
+    symtab->define(SymbolKind(kind), name, type);
+  else
+    symtab->declare(SymbolKind(kind), name, type);
+}
+
+void InterfaceReader::read_members(const std::shared_ptr<Type> &type) {
+  uint64_t num_members = get_uint();
+  for (uint64_t i = 0; i < num_members; ++i) {
+    std::string name = get_str();
+    type->add_member(Member(name, get_type_ref()));
+  }
+}
+
+uint64_t InterfaceReader::get_uint() {
+  uint64_t val = 0;
+  unsigned shift = 0;
+  for (;;) {
+    if (m_pos >= m_buf.size() || shift > 63)
+      corrupt();
+    unsigned char byte = (unsigned char) m_buf[m_pos++];
+    val |= uint64_t(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0)
+      return val;
+    shift += 7;
+  }
+}
+
+std::string InterfaceReader::get_str() {
+  uint64_t len = get_uint();
+  if (len > m_buf.size() - m_pos)
+    corrupt();
+  std::string s = m_buf.substr(m_pos, len);
+  m_pos += len;
+  return s;
+}
+
+std::shared_ptr<Type> InterfaceReader::get_type_ref() {
+  uint64_t id = get_uint();
+  if (id >= m_types.size())
+    corrupt();
+  return m_types[id];
+}
+
+void InterfaceReader::corrupt() const {
+  RuntimeError::raise("'%s' is not a valid interface file", m_filename.c_str());
+}
@@ -0,0 +1,95 @@
+#ifndef INTERFACE_H
+#define INTERFACE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include "type.h"
+#include "symtab.h"
+
+// Module interface files: the contents of a global SymbolTable
+// (symbols and their Types) are saved in a compact binary form,
+// so that later compilations can import them into their global
+// scope rather than re-analyzing the same struct and function
+// declarations (similar in spirit to precompiled headers).
+//
+// File format: the magic bytes "NCCI", a format version, and then
+// a sequence of records, terminated by an END record. All integers
+// are unsigned LEB128 varints, and strings are written as a length
+// followed by the raw bytes. Types are numbered in the order in which
+// their records appear, and a record only refers to types that were
+// written before it. The one exception is that the members of a struct
+// are written in a separate record following the struct itself,
+// so that recursive struct types (e.g., linked list nodes)
+// can refer to themselves.
+
+enum InterfaceRecord {
+  IREC_END = 0,
+  IREC_BASIC_TYPE,
+  IREC_QUALIFIED_TYPE,
+  IREC_POINTER_TYPE,
+  IREC_ARRAY_TYPE,
+  IREC_FUNCTION_TYPE,
+  IREC_STRUCT_TYPE,
+  IREC_STRUCT_MEMBERS,
+  IREC_SYMBOL,
+};
+
+class InterfaceWriter {
+private:
+  std::string m_buf;
+  std::map<const Type *, unsigned> m_type_ids;
+  unsigned m_num_types;
+
+  // value semantics prohibited
+  InterfaceWriter(const InterfaceWriter &);
+  InterfaceWriter &operator=(const InterfaceWriter &);
+
+public:
+  InterfaceWriter();
+  ~InterfaceWriter();
+
+  // write all of the symbols in the given (global) symbol table
+  // to the named interface file
+  void write(const SymbolTable *symtab, const std::string &filename);
+
+private:
+  unsigned encode_type(const std::shared_ptr<Type> &type);
+  void encode_members(const Type *type);
+  void put_uint(uint64_t val);
+  void put_str(const std::string &s);
+};
+
+class InterfaceReader {
+private:
+  std::string m_filename;
+  std::string m_buf;
+  size_t m_pos;
+  std::vector<std::shared_ptr<Type>> m_types;
+  std::set<const Type *> m_existing_structs;
+
+  // value semantics prohibited
+  InterfaceReader(const InterfaceReader &);
+  InterfaceReader &operator=(const InterfaceReader &);
+
+public:
+  InterfaceReader();
+  ~InterfaceReader();
+
+  // read the named interface file, adding its symbols to the
+  // given (global) symbol table
+  void read(const std::string &filename, SymbolTable *symtab);
+
+private:
+  void import_symbol(SymbolTable *symtab);
+  void read_members(const std::shared_ptr<Type> &type);
+  uint64_t get_uint();
+  std::string get_str();
+  std::shared_ptr<Type> get_type_ref();
+  void corrupt() const;
+};
+
+#endif // INTERFACE_H
@@ -38,7 +38,7 @@ public:
 
   bool is_valid() const { return m_line > 0; }
 
-  std::string get_srcfile() const { return m_srcfile; }
+  const std::string &get_srcfile() const { return m_srcfile; }
   int get_line() const { return m_line; }
   int get_col() const { return m_col; }
 
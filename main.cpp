@@ -19,82 +19,385 @@
 // OTHER DEALINGS IN THE SOFTWARE.
 
 #include <cstdlib>
+#include <climits>
+#include <memory>
 #include "context.h"
 #include "ast.h"
 #include "grammar_symbols.h"
 #include "node.h"
 #include "exceptions.h"
+#include "compile_server.h"
+#include "profile.h"
+#include "memstats.h"
+#include "ast_stats.h"
+#include "outbuf.h"
+#include "diagnostics.h"
+#include "ast_export.h"
 
-void usage() {
+int usage() {
   fprintf(stderr, "Usage: nearly_c [options...] <filename>\n"
                   "Options:\n"
                   "  -l   print tokens\n"
                   "  -p   print parse tree\n"
-                  "  -a   perform semantic analysis, print symbol table\n");
-  exit(1);
+                  "  -a   perform semantic analysis, print symbol table\n"
+                  "  --stats                  perform semantic analysis, print statistics about\n"
+                  "                           the AST, symbol tables, and types\n"
+                  "  --print-depth=<n>        with -p, print only nodes at most <n> levels\n"
+                  "                           below the root (0 for no limit)\n"
+                  "  --print-max-nodes=<n>    with -p, stop after printing <n> nodes\n"
+                  "                           (0 for no limit)\n"
+                  "  --export-ast=<file>      with -a or --stats, write the annotated AST\n"
+                  "                           to <file> (see ast_export.h)\n"
+                  "  --export-ast-format=binary|ndjson\n"
+                  "                           with -a or --stats, format of the exported\n"
+                  "                           AST (default binary)\n"
+                  "  --import=<file>          with -a or --stats, import declarations from\n"
+                  "                           an interface file\n"
+                  "  --emit-interface=<file>  with -a or --stats, save global declarations\n"
+                  "                           to an interface file\n"
+                  "  --time-report            print time spent in each phase, and counts\n"
+                  "                           of objects created, to stderr\n"
+                  "  --time-report=<file>     write the time report to <file> as JSON\n"
+                  "  --mem-report             print heap allocations per phase and per\n"
+                  "                           subsystem to stderr (included in the JSON\n"
+                  "                           time report, if one is written)\n"
+                  "  --trace=<file>           write a timeline of the compilation phases\n"
+                  "                           to <file> in Chrome trace event format\n"
+                  "  --stream                 with -a or --stats, analyze each top-level\n"
+                  "                           declaration as soon as it is parsed, and\n"
+                  "                           then free it\n"
+                  "  --max-errors=<n>         with -a or --stats, stop after <n> semantic\n"
+                  "                           errors (default 20, 0 for no limit)\n"
+                  "  --jobs=<n>               with -a or --stats, analyze function bodies\n"
+                  "                           using <n> threads (ignored with --stream)\n"
+                  "  --lexer=flex|direct      choose the lexer: the flex scanner (the default)\n"
+                  "                           or the hand-written direct lexer\n"
+                  "  --server=<socket>        run as a compile server listening on <socket>\n"
+                  "  --client=<socket>        forward this compilation to a compile server\n"
+                  "                           (--server and --client must be the first option)\n");
+  return 1;
 }
 
 enum class Mode {
   PRINT_TOKENS,
   PRINT_PARSE_TREE,
   SEMANTIC_ANALYSIS,
+  STATISTICS,
   COMPILE,
 };
 
-void process_source_file(const std::string &filename, Mode mode);
+struct Options {
+  Mode mode;
+  std::vector<std::string> imports;   // interface files to import
+  std::string interface_file;         // interface file to write (if any)
+  std::string export_ast_file;        // file to export the annotated AST to (if any)
+  ASTExportFormat export_ast_format;  // format of the exported AST
+  bool time_report;                   // true if a time report was requested
+  std::string time_report_file;       // file for JSON time report (if any)
+  bool mem_report;                    // true if a memory report was requested
+  std::string trace_file;             // file for trace events (if any)
+  LexerKind lexer_kind;               // which lexer to use
+  bool stream;                        // true to analyze one declaration at a time
+  unsigned jobs;                      // number of threads for semantic analysis
+  unsigned max_errors;                // maximum number of errors reported (0 for no limit)
+  unsigned print_depth;               // depth limit for -p (0 for no limit)
+  unsigned long print_max_nodes;      // node limit for -p (0 for no limit)
+
+  Options()
+    : mode(Mode::COMPILE), export_ast_format(ASTExportFormat::BINARY), time_report(false), mem_report(false), lexer_kind(LexerKind::FLEX), stream(false)
+    , jobs(1), max_errors(Diagnostics::DEFAULT_MAX_ERRORS), print_depth(0), print_max_nodes(0) { }
+};
+
+void process_source_file(const std::string &filename, const Options &opts, Diagnostics &diags);
+int compile(const std::vector<std::string> &args);
+
+namespace {
+
+// If arg has the form "<prefix><value>", store the value and return true
+bool get_option_value(const std::string &arg, const std::string &prefix, std::string &value) {
+  if (arg.compare(0, prefix.size(), prefix) != 0)
+    return false;
+  value = arg.substr(prefix.size());
+  return true;
+}
+
+// Print each token as it is scanned (for -l)
+class TokenPrinter : public TokenSink {
+private:
+  OutputBuffer &m_out;
+
+public:
+  TokenPrinter(OutputBuffer &out) : m_out(out) { }
+
+  virtual void token(Node *tok) {
+    std::unique_ptr<Node> owned(tok);
+    m_out.append_int(tok->get_tag());
+    m_out.append(':');
+    m_out.append(get_grammar_symbol_name(tok->get_tag()));
+    m_out.append('[');
+    m_out.append(tok->get_str());
+    m_out.append("]\n", 2);
+  }
+};
+
+void print_error(const BaseException &ex) {
+  const Location &loc = ex.get_loc();
+  if (loc.is_valid()) {
+    fprintf(stderr, "%s:%d:%d:Error: %s\n", loc.get_srcfile().c_str(), loc.get_line(), loc.get_col(), ex.what());
+  } else {
+    fprintf(stderr, "Error: %s\n", ex.what());
+  }
+}
+
+}
 
 int main(int argc, char **argv) {
-  if (argc < 2) {
-    usage();
+  std::vector<std::string> args(argv + 1, argv + argc);
+  std::string socket_path;
+
+  try {
+    if (!args.empty() && get_option_value(args[0], "--server=", socket_path)) {
+      // Handle compile requests until killed
+      CompileServer server(socket_path, compile);
+      server.run();
+      return 0;
+    }
+
+    if (!args.empty() && get_option_value(args[0], "--client=", socket_path)) {
+      args.erase(args.begin());
+      return forward_to_server(socket_path, args);
+    }
+  } catch (BaseException &ex) {
+    fprintf(stderr, "Error: %s\n", ex.what());
+    return 1;
+  }
+
+  return compile(args);
+}
+
+// Run one compilation: returns the exit status. Note that this is
+// called once per request in server mode, so it must not exit().
+int compile(const std::vector<std::string> &args) {
+  if (args.empty()) {
+    return usage();
   }
 
-  Mode mode = Mode::COMPILE;
+  Options opts;
+  // the last option given that is only used by -a and --stats,
+  // or only by -p (so that it isn't silently ignored in other modes)
+  const char *analysis_option = nullptr;
+  const char *print_option = nullptr;
 
-  int index = 1;
-  while (index < argc) {
-    std::string arg(argv[index]);
+  unsigned index = 0;
+  while (index < args.size()) {
+    const std::string &arg = args[index];
+    std::string value;
     if (arg == "-l") {
-      mode = Mode::PRINT_TOKENS;
+      opts.mode = Mode::PRINT_TOKENS;
     } else if (arg == "-p") {
-      mode = Mode::PRINT_PARSE_TREE;
+      opts.mode = Mode::PRINT_PARSE_TREE;
     } else if (arg == "-a") {
-      mode = Mode::SEMANTIC_ANALYSIS;
+      opts.mode = Mode::SEMANTIC_ANALYSIS;
+    } else if (arg == "--stats") {
+      opts.mode = Mode::STATISTICS;
+    } else if (get_option_value(arg, "--import=", value)) {
+      opts.imports.push_back(value);
+      analysis_option = "--import";
+    } else if (get_option_value(arg, "--emit-interface=", value)) {
+      opts.interface_file = value;
+      analysis_option = "--emit-interface";
+    } else if (get_option_value(arg, "--export-ast=", value)) {
+      opts.export_ast_file = value;
+      analysis_option = "--export-ast";
+    } else if (get_option_value(arg, "--export-ast-format=", value)) {
+      if (value == "binary") {
+        opts.export_ast_format = ASTExportFormat::BINARY;
+      } else if (value == "ndjson") {
+        opts.export_ast_format = ASTExportFormat::NDJSON;
+      } else {
+        fprintf(stderr, "Error: unknown AST export format '%s'\n", value.c_str());
+        return usage();
+      }
+      analysis_option = "--export-ast-format";
+    } else if (arg == "--time-report") {
+      opts.time_report = true;
+    } else if (get_option_value(arg, "--time-report=", value)) {
+      opts.time_report = true;
+      opts.time_report_file = value;
+    } else if (arg == "--mem-report") {
+      opts.mem_report = true;
+    } else if (get_option_value(arg, "--trace=", value)) {
+      opts.trace_file = value;
+    } else if (arg == "--stream") {
+      opts.stream = true;
+      analysis_option = "--stream";
+    } else if (get_option_value(arg, "--jobs=", value)) {
+      char *end;
+      unsigned long jobs = strtoul(value.c_str(), &end, 10);
+      if (value.empty() || *end != '\0' || jobs < 1 || jobs > 1024) {
+        fprintf(stderr, "Error: invalid number of jobs '%s'\n", value.c_str());
+        return usage();
+      }
+      opts.jobs = unsigned(jobs);
+      analysis_option = "--jobs";
+    } else if (get_option_value(arg, "--max-errors=", value)) {
+      char *end;
+      unsigned long max_errors = strtoul(value.c_str(), &end, 10);
+      if (value.empty() || *end != '\0' || max_errors > UINT_MAX) {
+        fprintf(stderr, "Error: invalid maximum number of errors '%s'\n", value.c_str());
+        return usage();
+      }
+      opts.max_errors = unsigned(max_errors);
+      analysis_option = "--max-errors";
+    } else if (get_option_value(arg, "--print-depth=", value)) {
+      char *end;
+      unsigned long depth = strtoul(value.c_str(), &end, 10);
+      if (value.empty() || *end != '\0' || depth > UINT_MAX) {
+        fprintf(stderr, "Error: invalid print depth '%s'\n", value.c_str());
+        return usage();
+      }
+      opts.print_depth = unsigned(depth);
+      print_option = "--print-depth";
+    } else if (get_option_value(arg, "--print-max-nodes=", value)) {
+      char *end;
+      unsigned long max_nodes = strtoul(value.c_str(), &end, 10);
+      if (value.empty() || *end != '\0') {
+        fprintf(stderr, "Error: invalid maximum number of nodes '%s'\n", value.c_str());
+        return usage();
+      }
+      opts.print_max_nodes = max_nodes;
+      print_option = "--print-max-nodes";
+    } else if (get_option_value(arg, "--lexer=", value)) {
+      if (value == "flex") {
+        opts.lexer_kind = LexerKind::FLEX;
+      } else if (value == "direct") {
+        opts.lexer_kind = LexerKind::DIRECT;
+      } else {
+        fprintf(stderr, "Error: unknown lexer '%s'\n", value.c_str());
+        return usage();
+      }
     } else {
       break;
     }
     index++;
   }
 
-  if (index >= argc) {
-    usage();
+  if (index >= args.size()) {
+    return usage();
   }
 
-  const char *filename = argv[index];
+  if (analysis_option != nullptr && opts.mode != Mode::SEMANTIC_ANALYSIS && opts.mode != Mode::STATISTICS) {
+    fprintf(stderr, "Error: %s can only be used with -a or --stats\n", analysis_option);
+    return usage();
+  }
+  if (print_option != nullptr && opts.mode != Mode::PRINT_PARSE_TREE) {
+    fprintf(stderr, "Error: %s can only be used with -p\n", print_option);
+    return usage();
+  }
+
+  // in server mode, don't carry over counts from a previous request
+  // (memory accounting needs the phase timers, and statistics need the
+  // count of Type objects allocated, so they enable profiling)
+  Profile::set_enabled(opts.time_report || opts.mem_report || opts.mode == Mode::STATISTICS);
+  Profile::set_tracing(!opts.trace_file.empty());
+  Profile::reset();
+  MemStats::set_enabled(opts.mem_report);
+  MemStats::reset();
+
+  const std::string &filename = args[index];
+  int status = 0;
+  Diagnostics diags(opts.max_errors);
   try {
-    process_source_file(filename, mode);
+    process_source_file(filename, opts, diags);
   } catch (BaseException &ex) {
-    const Location &loc = ex.get_loc();
-    if (loc.is_valid()) {
-      fprintf(stderr, "%s:%d:%d:Error: %s\n", loc.get_srcfile().c_str(), loc.get_line(), loc.get_col(), ex.what());
-    } else {
-      fprintf(stderr, "Error: %s\n", ex.what());
+    // errors recorded before this one are reported first
+    diags.fatal(ex);
+  }
+  if (diags.has_errors()) {
+    diags.print(stderr);
+    status = 1;
+  }
+
+  // the report is produced even if compilation failed,
+  // since the time up to the error may be of interest
+  if (opts.time_report || opts.mem_report || !opts.trace_file.empty()) {
+    try {
+      fflush(stdout);
+      if (opts.time_report && opts.time_report_file.empty())
+        Profile::print_report(stderr);
+      if (opts.mem_report && opts.time_report_file.empty())
+        Profile::print_mem_report(stderr);
+      if (!opts.time_report_file.empty())
+        Profile::write_json(opts.time_report_file);
+      if (!opts.trace_file.empty())
+        Profile::write_trace(opts.trace_file);
+    } catch (BaseException &ex) {
+      print_error(ex);
+      status = 1;
     }
-    exit(1);
   }
+  MemStats::set_enabled(false);
 
-  return 0;
+  return status;
 }
 
-void process_source_file(const std::string &filename, Mode mode) {
+void process_source_file(const std::string &filename, const Options &opts, Diagnostics &diags) {
+  ScopedTimer timer("compile", filename);
+  // the statistics and the AST exporter must outlive the Context,
+  // since the Context (and its semantic analysis) refer to them
+  ASTStats stats;
+  std::unique_ptr<ASTExporter> exporter;
   Context ctx;
+  ctx.set_lexer(opts.lexer_kind);
+  ctx.set_jobs(opts.jobs);
+  ctx.set_diagnostics(&diags);
+  Mode mode = opts.mode;
 
   if (mode == Mode::PRINT_TOKENS) {
-    std::vector<Node *> tokens;
-    ctx.scan_tokens(filename, tokens);
-    for (auto i = tokens.begin(); i != tokens.end(); ++i) {
-      Node *tok = *i;
-      printf("%d:%s[%s]\n", tok->get_tag(), get_grammar_symbol_name(tok->get_tag()), tok->get_str().c_str());
-      delete tok;
+    // tokens are printed as they are scanned
+    fflush(stdout);
+    OutputBuffer out(stdout);
+    TokenPrinter printer(out);
+    ctx.scan_tokens(filename, printer);
+    out.flush();
+  } else if (mode == Mode::SEMANTIC_ANALYSIS || mode == Mode::STATISTICS) {
+    // Parse the input (unless each declaration will be analyzed
+    // as soon as it is parsed)
+    if (!opts.stream) {
+      ctx.parse(filename);
+    }
+
+    // Perform semantic analysis, print symbol table (or statistics)
+    if (mode == Mode::STATISTICS) {
+      ctx.set_stats(&stats);
+    }
+    for (auto i = opts.imports.begin(); i != opts.imports.end(); ++i) {
+      ctx.import_interface(*i);
+    }
+    if (!opts.export_ast_file.empty()) {
+      exporter.reset(new ASTExporter(opts.export_ast_file, opts.export_ast_format));
+      ctx.set_ast_exporter(exporter.get());
+    }
+    if (opts.stream) {
+      ctx.analyze_stream(filename);
+    } else {
+      ctx.analyze();
+    }
+    // the AST is exported even if there were errors
+    // (erroneous nodes have the "error" type)
+    if (exporter) {
+      exporter->finish();
+    }
+    if (diags.has_errors()) {
+      return;
+    }
+    if (mode == Mode::STATISTICS) {
+      stats.print(stdout, Profile::get_count(PROF_TYPES));
+    } else {
+      ctx.print_symbol_table();
+    }
+    if (!opts.interface_file.empty()) {
+      ctx.export_interface(opts.interface_file);
     }
   } else {
     // Parse the input
@@ -104,13 +407,12 @@ void process_source_file(const std::string &filename, Mode mode) {
       // Note that we use an ASTTreePrint object to print the parse
       // tree. That way, the parser can build either a parse tree or
       // an AST, and tree printing should work correctly.
+      ScopedTimer print_timer("print");
       Node *ast = ctx.get_ast();
       ASTTreePrint ptp;
+      ptp.set_max_depth(opts.print_depth);
+      ptp.set_max_nodes(opts.print_max_nodes);
       ptp.print(ast);
-    } else if (mode == Mode::SEMANTIC_ANALYSIS) {
-      // Perform semantic analysis, print symbol table
-      ctx.analyze();
-      ctx.print_symbol_table();
     } else if (mode == Mode::COMPILE) {
       printf("TODO: compile the source code\n");
     }
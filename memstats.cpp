@@ -0,0 +1,178 @@
+#include <cstdlib>
+#include <new>
+#include <malloc.h>
+#include <sys/resource.h>
+#include "memstats.h"
+
+namespace {
+
+const char *const SUBSYSTEM_NAMES[MEM_NUM_SUBSYSTEMS] = {
+  "Node",
+  "Type",
+  "Symbol",
+  "other",
+};
+
+// Counts for the current thread, used to measure phases (see
+// begin_phase() and end_phase()). The live bytes are the bytes
+// allocated minus the bytes freed by the thread.
+struct ThreadCounters {
+  unsigned long allocs, bytes;
+  long live, peak;
+};
+
+thread_local ThreadCounters t_counters;
+
+// raise the peak to the given live byte count, if necessary
+void update_peak(std::atomic<long> &peak, long live) {
+  long cur = peak.load(std::memory_order_relaxed);
+  while (live > cur && !peak.compare_exchange_weak(cur, live, std::memory_order_relaxed))
+    ;
+}
+
+void *allocate_block(size_t size, MemSubsystem subsystem) {
+  void *p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  if (MemStats::is_enabled())
+    MemStats::record_alloc(malloc_usable_size(p), subsystem);
+  return p;
+}
+
+void free_block(void *p, MemSubsystem subsystem) {
+  if (p == nullptr)
+    return;
+  if (MemStats::is_enabled())
+    MemStats::record_free(malloc_usable_size(p), subsystem);
+  free(p);
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////
+// Replacement global allocation functions
+////////////////////////////////////////////////////////////////////////
+
+// Note that the array and nothrow forms of operator new and
+// operator delete forward to these by default.
+
+void *operator new(size_t size) {
+  return allocate_block(size, MEM_OTHER);
+}
+
+void operator delete(void *p) noexcept {
+  free_block(p, MEM_OTHER);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  free_block(p, MEM_OTHER);
+}
+
+////////////////////////////////////////////////////////////////////////
+// MemStats implementation
+////////////////////////////////////////////////////////////////////////
+
+std::atomic<bool> MemStats::s_enabled;
+MemStats::Counters MemStats::s_counters[MEM_NUM_SUBSYSTEMS];
+std::atomic<unsigned long> MemStats::s_total_allocs, MemStats::s_total_bytes;
+std::atomic<long> MemStats::s_live, MemStats::s_peak;
+
+void MemStats::set_enabled(bool enabled) {
+  s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void MemStats::reset() {
+  for (unsigned i = 0; i < MEM_NUM_SUBSYSTEMS; ++i) {
+    s_counters[i].allocs.store(0, std::memory_order_relaxed);
+    s_counters[i].frees.store(0, std::memory_order_relaxed);
+    s_counters[i].bytes.store(0, std::memory_order_relaxed);
+    s_counters[i].live.store(0, std::memory_order_relaxed);
+  }
+  s_total_allocs.store(0, std::memory_order_relaxed);
+  s_total_bytes.store(0, std::memory_order_relaxed);
+  s_live.store(0, std::memory_order_relaxed);
+  s_peak.store(0, std::memory_order_relaxed);
+}
+
+void *MemStats::allocate(size_t size, MemSubsystem subsystem) {
+  return allocate_block(size, subsystem);
+}
+
+void MemStats::deallocate(void *p, MemSubsystem subsystem) {
+  free_block(p, subsystem);
+}
+
+void MemStats::record_alloc(size_t size, MemSubsystem subsystem) {
+  Counters &counters = s_counters[subsystem];
+  counters.allocs.fetch_add(1, std::memory_order_relaxed);
+  counters.bytes.fetch_add(size, std::memory_order_relaxed);
+  counters.live.fetch_add(long(size), std::memory_order_relaxed);
+  s_total_allocs.fetch_add(1, std::memory_order_relaxed);
+  s_total_bytes.fetch_add(size, std::memory_order_relaxed);
+  long live = s_live.fetch_add(long(size), std::memory_order_relaxed) + long(size);
+  update_peak(s_peak, live);
+
+  ThreadCounters &thread = t_counters;
+  ++thread.allocs;
+  thread.bytes += size;
+  thread.live += long(size);
+  if (thread.live > thread.peak)
+    thread.peak = thread.live;
+}
+
+void MemStats::record_free(size_t size, MemSubsystem subsystem) {
+  // Note that blocks allocated before accounting was enabled may be
+  // freed while it is enabled, so live byte counts are relative to
+  // the point where the counts were reset (and can be negative)
+  Counters &counters = s_counters[subsystem];
+  counters.frees.fetch_add(1, std::memory_order_relaxed);
+  counters.live.fetch_sub(long(size), std::memory_order_relaxed);
+  s_live.fetch_sub(long(size), std::memory_order_relaxed);
+  t_counters.live -= long(size);
+}
+
+unsigned long MemStats::get_allocs(MemSubsystem subsystem) {
+  return s_counters[subsystem].allocs.load(std::memory_order_relaxed);
+}
+
+unsigned long MemStats::get_frees(MemSubsystem subsystem) {
+  return s_counters[subsystem].frees.load(std::memory_order_relaxed);
+}
+
+unsigned long MemStats::get_bytes(MemSubsystem subsystem) {
+  return s_counters[subsystem].bytes.load(std::memory_order_relaxed);
+}
+
+long MemStats::get_live(MemSubsystem subsystem) {
+  return s_counters[subsystem].live.load(std::memory_order_relaxed);
+}
+
+const char *MemStats::get_subsystem_name(MemSubsystem subsystem) {
+  return SUBSYSTEM_NAMES[subsystem];
+}
+
+long MemStats::get_max_rss_kb() {
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+  return usage.ru_maxrss;
+}
+
+void MemStats::begin_phase(MemPhase &phase) {
+  ThreadCounters &thread = t_counters;
+  phase.allocs = thread.allocs;
+  phase.bytes = thread.bytes;
+  phase.start_live = s_live.load(std::memory_order_relaxed);
+  phase.start_thread_live = thread.live;
+  phase.saved_thread_peak = thread.peak;
+  thread.peak = thread.live;
+}
+
+void MemStats::end_phase(const MemPhase &phase, unsigned long &allocs, unsigned long &bytes, long &peak) {
+  ThreadCounters &thread = t_counters;
+  allocs = thread.allocs - phase.allocs;
+  bytes = thread.bytes - phase.bytes;
+  peak = phase.start_live + (thread.peak - phase.start_thread_live);
+  if (phase.saved_thread_peak > thread.peak)
+    thread.peak = phase.saved_thread_peak;
+}
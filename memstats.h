@@ -0,0 +1,95 @@
+#ifndef MEMSTATS_H
+#define MEMSTATS_H
+
+#include <cstddef>
+#include <atomic>
+
+// Opt-in heap allocation accounting. The global operator new and
+// operator delete are replaced (see memstats.cpp) so that every heap
+// allocation can be counted, and Node, Type, and Symbol have
+// class-specific operator new/delete which attribute their objects
+// to a subsystem. Everything else (std::string data, container
+// storage, shared_ptr control blocks, etc.) is attributed to
+// MEM_OTHER. Sizes are the usable sizes of the blocks returned
+// by malloc, so they include allocator rounding.
+//
+// The per-phase numbers (allocations, bytes, and peak live bytes
+// during each phase) are gathered by the ScopedTimers in profile.h.
+// They are computed from per-thread counts, so that phases running
+// concurrently on different threads don't count each other's
+// allocations. A phase's peak is the process's live bytes when it
+// started, plus the most that its own thread added while it ran.
+
+enum MemSubsystem {
+  MEM_NODE,
+  MEM_TYPE,
+  MEM_SYMBOL,
+  MEM_OTHER,
+  MEM_NUM_SUBSYSTEMS,
+};
+
+// Allocation counts at the start of a phase, used to compute
+// the allocations made during the phase
+struct MemPhase {
+  unsigned long allocs;       // allocations made by the current thread
+  unsigned long bytes;
+  long start_live;            // live bytes in the process
+  long start_thread_live;     // net bytes allocated by the current thread
+  long saved_thread_peak;
+};
+
+class MemStats {
+private:
+  struct Counters {
+    std::atomic<unsigned long> allocs, frees, bytes;
+    std::atomic<long> live;
+  };
+
+  static std::atomic<bool> s_enabled;
+  static Counters s_counters[MEM_NUM_SUBSYSTEMS];
+  static std::atomic<unsigned long> s_total_allocs, s_total_bytes;
+  static std::atomic<long> s_live, s_peak;
+
+public:
+  static bool is_enabled() { return s_enabled.load(std::memory_order_relaxed); }
+  static void set_enabled(bool enabled);
+
+  // discard all counts (live and peak bytes are counted from this point)
+  static void reset();
+
+  // allocate/free memory attributed to the given subsystem
+  // (for use by class-specific operator new and operator delete)
+  static void *allocate(size_t size, MemSubsystem subsystem);
+  static void deallocate(void *p, MemSubsystem subsystem);
+
+  static unsigned long get_total_allocs() { return s_total_allocs.load(std::memory_order_relaxed); }
+  static unsigned long get_total_bytes() { return s_total_bytes.load(std::memory_order_relaxed); }
+  static long get_peak() { return s_peak.load(std::memory_order_relaxed); }
+
+  static unsigned long get_allocs(MemSubsystem subsystem);
+  static unsigned long get_frees(MemSubsystem subsystem);
+  static unsigned long get_bytes(MemSubsystem subsystem);
+  static long get_live(MemSubsystem subsystem);
+  static const char *get_subsystem_name(MemSubsystem subsystem);
+
+  // the process's maximum resident set size, in kilobytes
+  static long get_max_rss_kb();
+
+  // Record the start of a phase on the current thread: the thread's
+  // peak is reset to its current live bytes so that the peak within
+  // the phase can be measured.
+  static void begin_phase(MemPhase &phase);
+
+  // Record the end of a phase on the current thread, computing the
+  // allocations and bytes allocated by the thread during the phase,
+  // and the peak live bytes during the phase. The thread's overall
+  // peak is restored.
+  static void end_phase(const MemPhase &phase, unsigned long &allocs, unsigned long &bytes, long &peak);
+
+  // count an allocation or deallocation of a block of the given size
+  // (called by the allocation functions, if accounting is enabled)
+  static void record_alloc(size_t size, MemSubsystem subsystem);
+  static void record_free(size_t size, MemSubsystem subsystem);
+};
+
+#endif // MEMSTATS_H
@@ -18,6 +18,8 @@
 // ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 // OTHER DEALINGS IN THE SOFTWARE.
 
+#include "profile.h"
+#include "memstats.h"
 #include "node.h"
 
 // Private constructor, used only by other constructors
@@ -26,6 +28,7 @@ Node::Node(int tag, const std::string &str, const std::vector<Node *> &kids)
   , m_kids(kids)
   , m_str(str)
   , m_loc_was_set_explicitly(false) {
+  Profile::count(PROF_NODES);
 }
 
 // Private constructor, used only by other constructors
@@ -34,6 +37,7 @@ Node::Node(int tag, const std::string &str, const std::initializer_list<Node *>
   , m_kids(kids)
   , m_str(str)
   , m_loc_was_set_explicitly(false) {
+  Profile::count(PROF_NODES);
 }
 
 Node::Node(int tag)
@@ -61,12 +65,41 @@ Node::Node(int tag, const std::string &str)
 }
 
 Node::~Node() {
-  // delete child nodes
-  for (auto i = m_kids.begin(); i != m_kids.end(); ++i) {
-    delete *i;
+  // Delete the descendants. Each node's children are taken from it
+  // before it is deleted, so the nested destructor calls don't recurse,
+  // and arbitrarily deep trees can be deleted. (The stack is managed
+  // as in preorder().)
+  size_t top = m_kids.size();
+  if (top == 0)
+    return;
+  std::vector<Node *> stack;
+  stack.swap(m_kids);
+  Node **base = stack.data();
+  while (top > 0) {
+    Node *n = base[--top];
+    size_t num_kids = n->m_kids.size();
+    if (num_kids > 0) {
+      if (top + num_kids > stack.size()) {
+        stack.resize(2 * (top + num_kids));
+        base = stack.data();
+      }
+      Node *const *kids = n->m_kids.data();
+      for (size_t i = 0; i < num_kids; ++i)
+        base[top++] = kids[i];
+      n->m_kids.clear();
+    }
+    delete n;
   }
 }
 
+void *Node::operator new(size_t size) {
+  return MemStats::allocate(size, MEM_NODE);
+}
+
+void Node::operator delete(void *p) {
+  MemStats::deallocate(p, MEM_NODE);
+}
+
 void Node::append_kid(Node *kid) {
   m_kids.push_back(kid);
   // parent node's location defaults to first kid's location
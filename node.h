@@ -57,10 +57,15 @@ public:
 
   virtual ~Node();
 
+  // allocations are attributed to the Node subsystem
+  // in memory reports (see memstats.h)
+  static void *operator new(size_t size);
+  static void operator delete(void *p);
+
   int get_tag() const { return m_tag; }
   void set_tag(int tag) { m_tag = tag; }
 
-  std::string get_str() const { return m_str; }
+  const std::string &get_str() const { return m_str; }
   void set_str(const std::string &str) { m_str = str; }
 
   void append_kid(Node *kid);
@@ -81,12 +86,30 @@ public:
   const Location &get_loc() const { return m_loc; }
 
   // do a preorder traversal of the tree, invoking specified
-  // function on each node
+  // function on each node (an explicit stack is used, rather than
+  // recursion, so that arbitrarily deep trees can be traversed;
+  // the stack is grown explicitly, and the children are copied
+  // onto it directly, since this is a hot loop)
   template<typename Fn>
   void preorder(Fn fn) {
-    fn(this);
-    for (auto i = m_kids.begin(); i != m_kids.end(); ++i) {
-      (*i)->preorder(fn);
+    std::vector<Node *> stack(16);
+    Node **base = stack.data();
+    size_t top = 0;
+    base[top++] = this;
+    while (top > 0) {
+      Node *n = base[--top];
+      fn(n);
+      size_t num_kids = n->m_kids.size();
+      if (num_kids == 0)
+        continue;
+      if (top + num_kids > stack.size()) {
+        stack.resize(2 * (top + num_kids));
+        base = stack.data();
+      }
+      // push in reverse order, so the first child is visited first
+      Node *const *kids = n->m_kids.data();
+      for (size_t i = num_kids; i > 0; --i)
+        base[top++] = kids[i - 1];
     }
   }
 
@@ -51,11 +51,15 @@ bool NodeBase::has_symbol() const {
   return m_symbol != nullptr;
 }
 
+bool NodeBase::has_type() const {
+  return has_symbol() || m_type != nullptr;
+}
+
 Symbol *NodeBase::get_symbol() const {
   return m_symbol;
 }
 
-std::shared_ptr<Type> NodeBase::get_type() const {
+const std::shared_ptr<Type> &NodeBase::get_type() const {
   // this shouldn't be called unless there is actually a type
   // associated with this node
 
@@ -55,8 +55,11 @@ public:
   void set_type(const std::shared_ptr<Type> &type);
   void set_value_type(ValueType type);
   bool has_symbol() const;
+  bool has_type() const;
   Symbol *get_symbol() const;
-  std::shared_ptr<Type> get_type() const;
+  // returns a reference, so that looking at a node's type
+  // doesn't change the reference count
+  const std::shared_ptr<Type> &get_type() const;
   ValueType get_value_type() const;
 };
 
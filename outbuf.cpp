@@ -0,0 +1,51 @@
+#include "exceptions.h"
+#include "outbuf.h"
+
+OutputBuffer::OutputBuffer(FILE *out, size_t size)
+  : m_out(out)
+  , m_buf(new char[size])
+  , m_size(size)
+  , m_used(0) {
+}
+
+OutputBuffer::~OutputBuffer() {
+  // errors can't be reported from a destructor, so any
+  // text that can't be written is discarded
+  if (m_used > 0)
+    fwrite(m_buf, 1, m_used, m_out);
+  delete[] m_buf;
+}
+
+void OutputBuffer::append_int(long value) {
+  char digits[24];
+  char *p = digits + sizeof(digits);
+  unsigned long v = value < 0 ? 0UL - (unsigned long) value : (unsigned long) value;
+  do {
+    *--p = char('0' + v % 10);
+    v /= 10;
+  } while (v != 0);
+  if (value < 0)
+    *--p = '-';
+  append(p, size_t(digits + sizeof(digits) - p));
+}
+
+void OutputBuffer::flush() {
+  size_t used = m_used;
+  m_used = 0;
+  if (used > 0 && fwrite(m_buf, 1, used, m_out) != used) {
+    RuntimeError::raise("Error writing output");
+  }
+}
+
+void OutputBuffer::append_slow(const char *s, size_t len) {
+  flush();
+  if (len >= m_size) {
+    // too large to buffer, so write it directly
+    if (fwrite(s, 1, len, m_out) != len) {
+      RuntimeError::raise("Error writing output");
+    }
+    return;
+  }
+  memcpy(m_buf, s, len);
+  m_used = len;
+}
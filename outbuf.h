@@ -0,0 +1,58 @@
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+// A large output buffer for writing lots of small pieces of text
+// (such as one line per token) without the overhead of formatting
+// each one with printf. The buffered text is written to the output
+// file when the buffer fills, when flush() is called, and when the
+// OutputBuffer is destroyed.
+class OutputBuffer {
+private:
+  FILE *m_out;
+  char *m_buf;
+  size_t m_size, m_used;
+
+  // value semantics prohibited
+  OutputBuffer(const OutputBuffer &);
+  OutputBuffer &operator=(const OutputBuffer &);
+
+public:
+  static const size_t DEFAULT_SIZE = 1 << 16;
+
+  OutputBuffer(FILE *out, size_t size = DEFAULT_SIZE);
+  ~OutputBuffer();
+
+  void append(const char *s, size_t len) {
+    if (len > m_size - m_used) {
+      append_slow(s, len);
+      return;
+    }
+    memcpy(m_buf + m_used, s, len);
+    m_used += len;
+  }
+
+  void append(const char *s) { append(s, strlen(s)); }
+  void append(const std::string &s) { append(s.data(), s.size()); }
+
+  void append(char c) {
+    if (m_used == m_size)
+      flush();
+    m_buf[m_used++] = c;
+  }
+
+  // append the decimal representation of an integer
+  void append_int(long value);
+
+  // write the buffered text to the output file;
+  // throws a RuntimeError if the write fails
+  void flush();
+
+private:
+  void append_slow(const char *s, size_t len);
+};
+
+#endif // OUTBUF_H
@@ -22,20 +22,17 @@
 // parse.y
 // This is the parser that builds ASTs
 
+#include <unordered_set>
 #include "node.h"
 #include "parser_state.h"
 #include "grammar_symbols.h"
 #include "ast.h"
 #include "yyerror.h"
 
-// This is a weird hack required to make bison pass the
-// yyscan_t value representing the scanner state (which is
-// stored in the ParserState object) to yylex()
-#define the_scanner pp->scan_info
-
-// Bison does not actually declare yylex()
-typedef union YYSTYPE YYSTYPE;
-int yylex(YYSTYPE *, void *);
+// The parser gets its tokens from lex_token() (declared in
+// parser_state.h), which calls either the flex scanner or the
+// DirectLexer, depending on how the ParserState was set up
+#define yylex lex_token
 
 namespace {
   // All variable declarations default to having "unspecified" storage.
@@ -48,7 +45,38 @@ namespace {
     ast->prepend_kid(unspecified_storage);
     pp->tokens.push_back(unspecified_storage);
   }
+
+  // Add a top-level declaration to the unit, or if the ParserState
+  // has a top-level handler, pass the declaration to it instead.
+  // In the latter case, the tokens created so far are no longer
+  // tracked: those in the declaration are now owned by the handler,
+  // and the rest weren't incorporated into the tree and can be
+  // deleted (except for the parser's lookahead token, if any).
+  void handle_top_level_declaration(Node *unit, Node *decl, Node *lookahead, struct ParserState *pp) {
+    if (!pp->top_level_handler) {
+      unit->append_kid(decl);
+      return;
+    }
+
+    std::unordered_set<Node *> decl_nodes;
+    decl->preorder([&decl_nodes](Node *n) { decl_nodes.insert(n); });
+
+    for (auto i = pp->tokens.begin(); i != pp->tokens.end(); ++i) {
+      if (*i != lookahead && decl_nodes.count(*i) == 0) {
+        delete *i;
+      }
+    }
+    pp->tokens.clear();
+    if (lookahead != nullptr) {
+      pp->tokens.push_back(lookahead);
+    }
+
+    pp->top_level_handler(decl);
+  }
 }
+
+// The Node for the parser's lookahead token (if one has been read)
+#define LOOKAHEAD_NODE() ((yychar != YYEMPTY && yychar != YYEOF) ? yylval.node : nullptr)
 %}
 
 %define api.pure
@@ -60,12 +88,10 @@ namespace {
 %parse-param { struct ParserState *pp }
 
   /*
-   * Note that lex-param only controls the actual argument to yylex,
-   * and can only consist of a single token (hence the need to make
-   * it a #define so the lexer state can be accessed within the
-   * ParserState object
+   * The ParserState is also passed to the lexer, so that it can
+   * find the lexer state
    */
-%lex-param { the_scanner }
+%lex-param { pp }
 
   /*
    * We expect one shift/reduce conflict due to the "dangling else" problem.
@@ -97,13 +123,20 @@ namespace {
 %token<node> TOK_SUB_ASSIGN TOK_LEFT_ASSIGN TOK_RIGHT_ASSIGN TOK_AND_ASSIGN TOK_XOR_ASSIGN
 %token<node> TOK_OR_ASSIGN
 
-%token<node> TOK_IF TOK_ELSE TOK_WHILE TOK_FOR TOK_DO TOK_SWITCH TOK_CASE
-%token<node> TOK_CHAR TOK_SHORT TOK_INT TOK_LONG TOK_UNSIGNED TOK_SIGNED
-%token<node> TOK_FLOAT TOK_DOUBLE
-%token<node> TOK_VOID
-%token<node> TOK_RETURN TOK_BREAK TOK_CONTINUE
-%token<node> TOK_CONST TOK_VOLATILE
-%token<node> TOK_STRUCT TOK_UNION
+  /*
+   * Keywords: the string alias of each keyword token is its spelling.
+   * scan_grammar_symbols.rb uses the aliases to generate the
+   * lookup_keyword() function the lexers use to recognize keywords.
+   */
+%token<node> TOK_IF "if" TOK_ELSE "else" TOK_WHILE "while" TOK_FOR "for"
+%token<node> TOK_DO "do" TOK_SWITCH "switch" TOK_CASE "case"
+%token<node> TOK_CHAR "char" TOK_SHORT "short" TOK_INT "int" TOK_LONG "long"
+%token<node> TOK_UNSIGNED "unsigned" TOK_SIGNED "signed"
+%token<node> TOK_FLOAT "float" TOK_DOUBLE "double"
+%token<node> TOK_VOID "void"
+%token<node> TOK_RETURN "return" TOK_BREAK "break" TOK_CONTINUE "continue"
+%token<node> TOK_CONST "const" TOK_VOLATILE "volatile"
+%token<node> TOK_STRUCT "struct" TOK_UNION "union"
 
   /*
    * Storage class specifiers: because storage class is optional,
@@ -117,12 +150,27 @@ namespace {
    * TOK_UNSPECIFIED_STORAGE, and it will never appear in a parse tree.
    */
 %token<node> TOK_UNSPECIFIED_STORAGE
-%token<node> TOK_STATIC TOK_EXTERN TOK_AUTO
+%token<node> TOK_STATIC "static" TOK_EXTERN "extern" TOK_AUTO "auto"
 
 %token<node> TOK_IDENT
 
 %token<node> TOK_STR_LIT TOK_CHAR_LIT TOK_INT_LIT TOK_FP_LIT
 
+  /*
+   * Precedence and associativity of the binary operators
+   * (lowest precedence first)
+   */
+%left TOK_LOGICAL_OR
+%left TOK_LOGICAL_AND
+%left TOK_BITWISE_OR
+%left TOK_BITWISE_XOR
+%left TOK_AMPERSAND
+%left TOK_EQUALITY TOK_INEQUALITY
+%left TOK_LT TOK_LTE TOK_GT TOK_GTE
+%left TOK_LEFT_SHIFT TOK_RIGHT_SHIFT
+%left TOK_PLUS TOK_MINUS
+%left TOK_ASTERISK TOK_DIVIDE TOK_MOD
+
 %type<node> unit top_level_declaration function_or_variable_declaration_or_definition
 %type<node> simple_variable_declaration
 %type<node> declarator_list declarator non_pointer_declarator
@@ -133,10 +181,7 @@ namespace {
 %type<node> struct_type_definition union_type_definition
 %type<node> opt_simple_variable_declaration_list simple_variable_declaration_list
 %type<node> assignment_expression assignment_op
-%type<node> conditional_expression logical_or_expression logical_and_expression
-%type<node> bitwise_and_expression bitwise_or_expression bitwise_xor_expression
-%type<node> equality_expression relational_expression relational_op
-%type<node> shift_expression additive_expression multiplicative_expression
+%type<node> conditional_expression binary_expression
 %type<node> cast_expression unary_expression postfix_expression primary_expression
 %type<node> argument_expression_list
 
@@ -144,9 +189,9 @@ namespace {
 
 unit
   : top_level_declaration
-   { pp->parse_tree = $$ = new Node(AST_UNIT, {$1}); }
-  | top_level_declaration unit
-    { pp->parse_tree = $$ = $2; $$->prepend_kid($1); }
+   { pp->parse_tree = $$ = new Node(AST_UNIT); handle_top_level_declaration($$, $1, LOOKAHEAD_NODE(), pp); }
+  | unit top_level_declaration
+    { pp->parse_tree = $$ = $1; handle_top_level_declaration($$, $2, LOOKAHEAD_NODE(), pp); }
   ;
 
 top_level_declaration
@@ -177,8 +222,8 @@ simple_variable_declaration
 declarator_list
   : declarator
     { $$ = new Node(AST_DECLARATOR_LIST, {$1}); }
-  | declarator TOK_COMMA declarator_list
-    { $$ = $3; $$->prepend_kid($1); }
+  | declarator_list TOK_COMMA declarator
+    { $$ = $1; $$->append_kid($3); }
   ;
 
   /* pointers are lower precedence than identifiers/arrays */
@@ -221,8 +266,8 @@ opt_parameter_list
 parameter_list
   : parameter
     { $$ = new Node(AST_FUNCTION_PARAMETER_LIST, {$1}); }
-  | parameter TOK_COMMA parameter_list
-    { $$ = $3; $$->prepend_kid($1); }
+  | parameter_list TOK_COMMA parameter
+    { $$ = $1; $$->append_kid($3); }
   ;
 
 parameter
@@ -247,8 +292,8 @@ type
 basic_type
   : basic_type_keyword
     { $$ = new Node(AST_BASIC_TYPE, {$1}); }
-  | basic_type_keyword basic_type
-    { $$ = $2; $$->prepend_kid($1); }
+  | basic_type basic_type_keyword
+    { $$ = $1; $$->append_kid($2); }
   ;
 
 basic_type_keyword
@@ -286,8 +331,8 @@ opt_statement_list
 statement_list
   : statement
     { $$ = new Node(AST_STATEMENT_LIST, {$1}); }
-  | statement statement_list
-    { $$ = $2; $$->prepend_kid($1); }
+  | statement_list statement
+    { $$ = $1; $$->append_kid($2); }
   ;
 
 statement
@@ -346,8 +391,8 @@ opt_simple_variable_declaration_list
 simple_variable_declaration_list
   : simple_variable_declaration
     { $$ = new Node(AST_FIELD_DEFINITION_LIST, {$1}); }
-  | simple_variable_declaration simple_variable_declaration_list
-    { $$ = $2; $$->prepend_kid($1); }
+  | simple_variable_declaration_list simple_variable_declaration
+    { $$ = $1; $$->append_kid($2); }
   ;
 
   /*
@@ -397,100 +442,59 @@ assignment_op
   ;
 
 conditional_expression
-  : logical_or_expression
+  : binary_expression
     { $$ = $1; }
-  | logical_or_expression TOK_QUESTION assignment_expression TOK_COLON conditional_expression
+  | binary_expression TOK_QUESTION assignment_expression TOK_COLON conditional_expression
     { $$ = new Node(AST_CONDITIONAL_EXPRESSION, {$1, $3, $5}); }
   ;
 
-logical_or_expression
-  : logical_and_expression
-    { $$ = $1; }
-  | logical_or_expression TOK_LOGICAL_OR logical_and_expression
-    { $$ = new Node(AST_BINARY_EXPRESSION, {$2, $1, $3}); }
-  ;
+  /*
+   * All of the binary operators other than assignment are handled
+   * by a single ambiguous nonterminal, using the operator precedence
+   * and associativity declarations to resolve the conflicts. This
+   * builds the same trees as a chain of nonterminals (one for each
+   * precedence level), but the parser does far less work: with the
+   * chain, each operand was reduced through every level.
+   */
 
-logical_and_expression
-  : bitwise_or_expression
+binary_expression
+  : cast_expression
     { $$ = $1; }
-  | logical_and_expression TOK_LOGICAL_AND bitwise_or_expression
+  | binary_expression TOK_LOGICAL_OR binary_expression
     { $$ = new Node(AST_BINARY_EXPRESSION, {$2, $1, $3}); }
-  ;
-
-bitwise_or_expression
-  : bitwise_xor_expression
-    { $$ = $1; }
-  | bitwise_or_expression TOK_BITWISE_OR bitwise_xor_expression
+  | binary_expression TOK_LOGICAL_AND binary_expression
     { $$ = new Node(AST_BINARY_EXPRESSION, {$2, $1, $3}); }
-  ;
-
-bitwise_xor_expression
-  : bitwise_and_expression
-    { $$ = $1; }
-  | bitwise_xor_expression TOK_BITWISE_XOR bitwise_and_expression
+  | binary_expression TOK_BITWISE_OR binary_expression
     { $$ = new Node(AST_BINARY_EXPRESSION, {$2, $1, $3}); }
-  ;
-
-bitwise_and_expression
-  : equality_expression
-    { $$ = $1; }
-  | bitwise_and_expression TOK_AMPERSAND equality_expression
+  | binary_expression TOK_BITWISE_XOR binary_expression
     { $$ = new Node(AST_BINARY_EXPRESSION, {$2, $1, $3}); }
-  ;
-
-equality_expression
-  : relational_expression
-    { $$ = $1; }
-  | equality_expression TOK_EQUALITY relational_expression
+  | binary_expression TOK_AMPERSAND binary_expression
     { $$ = new Node(AST_BINARY_EXPRESSION, {$2, $1, $3}); }
-  | equality_expression TOK_INEQUALITY relational_expression
+  | binary_expression TOK_EQUALITY binary_expression
     { $$ = new Node(AST_BINARY_EXPRESSION, {$2, $1, $3}); }
-  ;
-
-relational_expression
-  : shift_expression
-    { $$ = $1; }
-  | relational_expression relational_op shift_expression
+  | binary_expression TOK_INEQUALITY binary_expression
     { $$ = new Node(AST_BINARY_EXPRESSION, {$2, $1, $3}); }
-  ;
-
-relational_op
-  : TOK_LT
-    { $$ = $1; }
-  | TOK_LTE
-    { $$ = $1; }
-  | TOK_GT
-    { $$ = $1; }
-  | TOK_GTE
-    { $$ = $1; }
-  ;
-
-shift_expression
-  : additive_expression
-    { $$ = $1; }
-  | shift_expression TOK_LEFT_SHIFT additive_expression
+  | binary_expression TOK_LT binary_expression
     { $$ = new Node(AST_BINARY_EXPRESSION, {$2, $1, $3}); }
-  | shift_expression TOK_RIGHT_SHIFT additive_expression
+  | binary_expression TOK_LTE binary_expression
     { $$ = new Node(AST_BINARY_EXPRESSION, {$2, $1, $3}); }
-  ;
-
-additive_expression
-  : multiplicative_expression
-    { $$ = $1; }
-  | additive_expression TOK_PLUS multiplicative_expression
+  | binary_expression TOK_GT binary_expression
     { $$ = new Node(AST_BINARY_EXPRESSION, {$2, $1, $3}); }
-  | additive_expression TOK_MINUS multiplicative_expression
+  | binary_expression TOK_GTE binary_expression
     { $$ = new Node(AST_BINARY_EXPRESSION, {$2, $1, $3}); }
-  ;
-
-multiplicative_expression
-  : cast_expression
-    { $$ = $1; }
-  | multiplicative_expression TOK_ASTERISK cast_expression
+  | binary_expression TOK_LEFT_SHIFT binary_expression
+    { $$ = new Node(AST_BINARY_EXPRESSION, {$2, $1, $3}); }
+  | binary_expression TOK_RIGHT_SHIFT binary_expression
+    { $$ = new Node(AST_BINARY_EXPRESSION, {$2, $1, $3}); }
+  | binary_expression TOK_PLUS binary_expression
+    { $$ = new Node(AST_BINARY_EXPRESSION, {$2, $1, $3}); }
+  | binary_expression TOK_MINUS binary_expression
+    { $$ = new Node(AST_BINARY_EXPRESSION, {$2, $1, $3}); }
+  | binary_expression TOK_ASTERISK binary_expression
     { $$ = new Node(AST_BINARY_EXPRESSION, {$2, $1, $3}); }
-  | multiplicative_expression TOK_DIVIDE cast_expression
+  | binary_expression TOK_DIVIDE binary_expression
     { $$ = new Node(AST_BINARY_EXPRESSION, {$2, $1, $3}); }
-  | multiplicative_expression TOK_MOD cast_expression
+  | binary_expression TOK_MOD binary_expression
     { $$ = new Node(AST_BINARY_EXPRESSION, {$2, $1, $3}); }
   ;
 
@@ -552,8 +556,8 @@ postfix_expression
 argument_expression_list
   : assignment_expression
     { $$ = new Node(AST_ARGUMENT_EXPRESSION_LIST, {$1}); }
-  | assignment_expression TOK_COMMA argument_expression_list
-    { $$ = $3; $$->prepend_kid($1); }
+  | argument_expression_list TOK_COMMA assignment_expression
+    { $$ = $1; $$->append_kid($3); }
   ;
 
 primary_expression
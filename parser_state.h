@@ -22,14 +22,20 @@
 #define PARSER_STATE_H
 
 #include <vector>
+#include <functional>
 #include "location.h"
 class Node;
+class DirectLexer;
+union YYSTYPE;
 
 struct ParserState {
   // To avoid depending on yyscan_t, just hard-code knowledge that
   // yyscan_t is just a typedef for void *
   void *scan_info;
 
+  // if non-null, the DirectLexer is used instead of the flex scanner
+  DirectLexer *direct_lexer;
+
   // current location (used by lexer)
   Location cur_loc;
 
@@ -41,7 +47,17 @@ struct ParserState {
   // into the tree built by the parser.
   std::vector<Node *> tokens;
 
-  ParserState() : scan_info(nullptr), parse_tree(nullptr) { }
+  // If set, each top-level declaration is passed to this function
+  // as soon as it has been parsed, rather than being added to the
+  // unit (so the parse tree will be an empty unit). The function
+  // takes ownership of the declaration.
+  std::function<void(Node *)> top_level_handler;
+
+  ParserState() : scan_info(nullptr), direct_lexer(nullptr), parse_tree(nullptr) { }
 };
 
+// Get the next token from whichever lexer the ParserState uses
+// (this is the function the parser calls to get tokens)
+int lex_token(union YYSTYPE *semantic_value, ParserState *pp);
+
 #endif // PARSER_STATE_H
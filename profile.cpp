@@ -0,0 +1,457 @@
+#include <map>
+#include <set>
+#include <iterator>
+#include <mutex>
+#include <vector>
+#include "cpputil.h"
+#include "exceptions.h"
+#include "profile.h"
+
+namespace {
+
+struct TimerRecord {
+  std::string path;
+  unsigned long calls;
+  double secs, self_secs;
+  unsigned long allocs, alloc_bytes;
+  long peak;   // highest peak live bytes over all calls
+};
+
+const char *const COUNTER_NAMES[PROF_NUM_COUNTERS] = {
+  "tokens",
+  "nodes",
+  "symbols",
+  "types",
+  "scopes",
+};
+
+// Aggregated timer records, in the order in which each timer
+// was first started, along with an index by path. Timers may be
+// recorded by multiple threads, so access is synchronized.
+std::mutex g_timer_lock;
+std::vector<TimerRecord> g_timers;
+std::map<std::string, unsigned> g_timer_index;
+
+// innermost running timer on the current thread
+thread_local ScopedTimer *t_current_timer;
+
+// timer on another thread that the outermost timers on the
+// current thread are nested in (see WorkerTimerScope)
+thread_local ScopedTimer *t_worker_parent;
+
+// A span in the trace timeline
+struct TraceEvent {
+  const char *name;
+  std::string detail;
+  unsigned tid;
+  double start_us, dur_us;
+};
+
+// Trace events, and the time that trace timestamps are relative to
+std::vector<TraceEvent> g_trace_events;
+std::chrono::steady_clock::time_point g_trace_epoch = std::chrono::steady_clock::now();
+
+// Threads are numbered (starting from 1) in the order in which
+// they first record a trace event, which makes for a more
+// readable timeline than system thread ids
+std::atomic<unsigned> g_next_tid(1);
+thread_local unsigned t_tid;
+
+unsigned get_tid() {
+  if (t_tid == 0)
+    t_tid = g_next_tid.fetch_add(1, std::memory_order_relaxed);
+  return t_tid;
+}
+
+// the nesting depth of a timer is the number of '/' separators in its path
+unsigned get_depth(const std::string &path) {
+  unsigned depth = 0;
+  for (auto i = path.begin(); i != path.end(); ++i) {
+    if (*i == '/')
+      ++depth;
+  }
+  return depth;
+}
+
+// get the last component of a timer path
+std::string get_name(const std::string &path) {
+  size_t pos = path.rfind('/');
+  return pos == std::string::npos ? path : path.substr(pos + 1);
+}
+
+// total time of all outermost timers, used to compute percentages
+double get_total_secs(const std::vector<TimerRecord> &timers) {
+  double total = 0.0;
+  for (auto i = timers.begin(); i != timers.end(); ++i) {
+    if (get_depth(i->path) == 0)
+      total += i->secs;
+  }
+  return total;
+}
+
+// get the path of a timer's parent (empty for an outermost timer)
+std::string get_parent_path(const std::string &path) {
+  size_t pos = path.rfind('/');
+  return pos == std::string::npos ? "" : path.substr(0, pos);
+}
+
+void add_subtree(const std::vector<TimerRecord> &timers,
+                 const std::map<std::string, std::vector<unsigned>> &children,
+                 const std::string &path, std::vector<TimerRecord> &sorted) {
+  auto i = children.find(path);
+  if (i == children.end())
+    return;
+  for (auto j = i->second.begin(); j != i->second.end(); ++j) {
+    sorted.push_back(timers[*j]);
+    add_subtree(timers, children, timers[*j].path, sorted);
+  }
+}
+
+// get the timer records in tree order: each timer is followed
+// by its children, and siblings are in the order they were first started
+std::vector<TimerRecord> get_sorted_timers() {
+  std::vector<TimerRecord> timers;
+  {
+    std::lock_guard<std::mutex> guard(g_timer_lock);
+    timers = g_timers;
+  }
+
+  std::map<std::string, std::vector<unsigned>> children;
+  for (unsigned i = 0; i < timers.size(); ++i)
+    children[get_parent_path(timers[i].path)].push_back(i);
+
+  std::vector<TimerRecord> sorted;
+  add_subtree(timers, children, "", sorted);
+  return sorted;
+}
+
+}
+
+std::atomic<bool> Profile::s_enabled, Profile::s_tracing;
+std::atomic<unsigned long> Profile::s_counters[PROF_NUM_COUNTERS];
+
+void Profile::set_enabled(bool enabled) {
+  s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void Profile::set_tracing(bool tracing) {
+  s_tracing.store(tracing, std::memory_order_relaxed);
+}
+
+unsigned long Profile::get_count(ProfileCounter counter) {
+  return s_counters[counter].load(std::memory_order_relaxed);
+}
+
+const char *Profile::get_counter_name(ProfileCounter counter) {
+  return COUNTER_NAMES[counter];
+}
+
+void Profile::reset() {
+  for (unsigned i = 0; i < PROF_NUM_COUNTERS; ++i)
+    s_counters[i].store(0, std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> guard(g_timer_lock);
+  g_timers.clear();
+  g_timer_index.clear();
+  g_trace_events.clear();
+  g_trace_epoch = std::chrono::steady_clock::now();
+}
+
+unsigned Profile::register_timer(const std::string &path) {
+  std::lock_guard<std::mutex> guard(g_timer_lock);
+
+  auto i = g_timer_index.find(path);
+  if (i != g_timer_index.end())
+    return i->second;
+
+  TimerRecord rec;
+  rec.path = path;
+  rec.calls = 0;
+  rec.secs = rec.self_secs = 0.0;
+  rec.allocs = rec.alloc_bytes = 0;
+  rec.peak = 0;
+  g_timers.push_back(rec);
+  g_timer_index[path] = unsigned(g_timers.size() - 1);
+  return unsigned(g_timers.size() - 1);
+}
+
+void Profile::record_time(unsigned index, double secs, double child_secs) {
+  std::lock_guard<std::mutex> guard(g_timer_lock);
+
+  // the records may have been discarded by reset()
+  if (index >= g_timers.size())
+    return;
+
+  TimerRecord &rec = g_timers[index];
+  ++rec.calls;
+  rec.secs += secs;
+  rec.self_secs += secs - child_secs;
+}
+
+void Profile::record_mem(unsigned index, unsigned long allocs, unsigned long bytes, long peak) {
+  std::lock_guard<std::mutex> guard(g_timer_lock);
+
+  if (index >= g_timers.size())
+    return;
+
+  TimerRecord &rec = g_timers[index];
+  rec.allocs += allocs;
+  rec.alloc_bytes += bytes;
+  if (peak > rec.peak)
+    rec.peak = peak;
+}
+
+void Profile::record_span(const char *name, const std::string &detail,
+                          std::chrono::steady_clock::time_point start,
+                          std::chrono::steady_clock::time_point end) {
+  TraceEvent event;
+  event.name = name;
+  event.detail = detail;
+  event.tid = get_tid();
+
+  std::lock_guard<std::mutex> guard(g_timer_lock);
+  event.start_us = std::chrono::duration<double, std::micro>(start - g_trace_epoch).count();
+  event.dur_us = std::chrono::duration<double, std::micro>(end - start).count();
+  g_trace_events.push_back(event);
+}
+
+void Profile::print_report(FILE *out) {
+  std::vector<TimerRecord> timers = get_sorted_timers();
+  double total = get_total_secs(timers);
+
+  fprintf(out, "Time report:\n");
+  fprintf(out, "  %-32s %12s %12s %8s %7s\n", "phase", "wall ms", "self ms", "calls", "%");
+  for (auto i = timers.begin(); i != timers.end(); ++i) {
+    std::string name = std::string(2 * get_depth(i->path), ' ') + get_name(i->path);
+    fprintf(out, "  %-32s %12.3f %12.3f %8lu %6.1f%%\n",
+            name.c_str(), i->secs * 1000.0, i->self_secs * 1000.0, i->calls,
+            total > 0.0 ? 100.0 * i->secs / total : 0.0);
+  }
+
+  fprintf(out, "Counters:\n");
+  for (unsigned i = 0; i < PROF_NUM_COUNTERS; ++i) {
+    ProfileCounter counter = ProfileCounter(i);
+    fprintf(out, "  %-32s %12lu\n", get_counter_name(counter), get_count(counter));
+  }
+}
+
+void Profile::print_mem_report(FILE *out) {
+  std::vector<TimerRecord> timers = get_sorted_timers();
+
+  fprintf(out, "Memory report:\n");
+  fprintf(out, "  %-32s %12s %14s %14s\n", "phase", "allocs", "bytes", "peak live");
+  for (auto i = timers.begin(); i != timers.end(); ++i) {
+    std::string name = std::string(2 * get_depth(i->path), ' ') + get_name(i->path);
+    fprintf(out, "  %-32s %12lu %14lu %14ld\n", name.c_str(), i->allocs, i->alloc_bytes, i->peak);
+  }
+
+  fprintf(out, "  %-32s %12s %12s %14s %14s\n", "subsystem", "allocs", "frees", "bytes", "live");
+  for (unsigned i = 0; i < MEM_NUM_SUBSYSTEMS; ++i) {
+    MemSubsystem subsystem = MemSubsystem(i);
+    fprintf(out, "  %-32s %12lu %12lu %14lu %14ld\n", MemStats::get_subsystem_name(subsystem),
+            MemStats::get_allocs(subsystem), MemStats::get_frees(subsystem),
+            MemStats::get_bytes(subsystem), MemStats::get_live(subsystem));
+  }
+  fprintf(out, "  %-32s %12lu %12s %14lu\n", "total", MemStats::get_total_allocs(), "",
+          MemStats::get_total_bytes());
+  fprintf(out, "  peak live bytes: %ld\n", MemStats::get_peak());
+  fprintf(out, "  max RSS: %ld kB\n", MemStats::get_max_rss_kb());
+}
+
+void Profile::write_json(const std::string &filename) {
+  FILE *out = fopen(filename.c_str(), "w");
+  if (out == nullptr) {
+    RuntimeError::raise("Couldn't open '%s' for writing", filename.c_str());
+  }
+
+  // timer paths are made of phase names chosen by the compiler,
+  // so they don't need escaping
+  std::vector<TimerRecord> timers = get_sorted_timers();
+  bool mem = MemStats::is_enabled();
+  fprintf(out, "{\n  \"timers\": [\n");
+  for (auto i = timers.begin(); i != timers.end(); ++i) {
+    fprintf(out, "    {\"path\": \"%s\", \"depth\": %u, \"calls\": %lu, \"wall_ms\": %.3f, \"self_ms\": %.3f",
+            i->path.c_str(), get_depth(i->path), i->calls, i->secs * 1000.0, i->self_secs * 1000.0);
+    if (mem)
+      fprintf(out, ", \"allocs\": %lu, \"alloc_bytes\": %lu, \"peak_live_bytes\": %ld",
+              i->allocs, i->alloc_bytes, i->peak);
+    fprintf(out, "}%s\n", (i + 1 == timers.end()) ? "" : ",");
+  }
+  fprintf(out, "  ],\n  \"counters\": {\n");
+  for (unsigned i = 0; i < PROF_NUM_COUNTERS; ++i) {
+    ProfileCounter counter = ProfileCounter(i);
+    fprintf(out, "    \"%s\": %lu%s\n", get_counter_name(counter), get_count(counter),
+            (i + 1 == PROF_NUM_COUNTERS) ? "" : ",");
+  }
+  fprintf(out, "  }");
+  if (mem) {
+    fprintf(out, ",\n  \"memory\": {\n    \"subsystems\": {\n");
+    for (unsigned i = 0; i < MEM_NUM_SUBSYSTEMS; ++i) {
+      MemSubsystem subsystem = MemSubsystem(i);
+      fprintf(out, "      \"%s\": {\"allocs\": %lu, \"frees\": %lu, \"bytes\": %lu, \"live_bytes\": %ld}%s\n",
+              MemStats::get_subsystem_name(subsystem), MemStats::get_allocs(subsystem),
+              MemStats::get_frees(subsystem), MemStats::get_bytes(subsystem),
+              MemStats::get_live(subsystem), (i + 1 == MEM_NUM_SUBSYSTEMS) ? "" : ",");
+    }
+    fprintf(out, "    },\n    \"total_allocs\": %lu,\n    \"total_bytes\": %lu,\n"
+                 "    \"peak_live_bytes\": %ld,\n    \"max_rss_kb\": %ld\n  }",
+            MemStats::get_total_allocs(), MemStats::get_total_bytes(),
+            MemStats::get_peak(), MemStats::get_max_rss_kb());
+  }
+  fprintf(out, "\n}\n");
+
+  if (fclose(out) != 0) {
+    RuntimeError::raise("Couldn't write '%s'", filename.c_str());
+  }
+}
+
+void Profile::write_trace(const std::string &filename) {
+  std::vector<TraceEvent> events;
+  {
+    std::lock_guard<std::mutex> guard(g_timer_lock);
+    events = g_trace_events;
+  }
+
+  FILE *out = fopen(filename.c_str(), "w");
+  if (out == nullptr) {
+    RuntimeError::raise("Couldn't open '%s' for writing", filename.c_str());
+  }
+
+  // Each span is a complete ("X") event. Spans are recorded when they
+  // end, so a parent comes after its children, but the viewer nests
+  // spans on the same thread by their timestamps.
+  std::set<unsigned> tids;
+  fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  for (auto i = events.begin(); i != events.end(); ++i) {
+    tids.insert(i->tid);
+    fprintf(out, "  {\"name\": \"%s\", \"cat\": \"compile\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, "
+                 "\"ts\": %.3f, \"dur\": %.3f",
+            i->name, i->tid, i->start_us, i->dur_us);
+    if (!i->detail.empty())
+      fprintf(out, ", \"args\": {\"detail\": \"%s\"}", cpputil::json_escape(i->detail).c_str());
+    fprintf(out, "},\n");
+  }
+  // name the threads
+  for (auto i = tids.begin(); i != tids.end(); ++i) {
+    std::string thread_name = (*i == 1) ? "main" : "worker " + std::to_string(*i - 1);
+    fprintf(out, "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+                 "\"args\": {\"name\": \"%s\"}}%s\n",
+            *i, thread_name.c_str(), (std::next(i) == tids.end()) ? "" : ",");
+  }
+  fprintf(out, "]}\n");
+
+  if (fclose(out) != 0) {
+    RuntimeError::raise("Couldn't write '%s'", filename.c_str());
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+// ScopedTimer implementation
+////////////////////////////////////////////////////////////////////////
+
+ScopedTimer::ScopedTimer(const char *name)
+  : m_active(Profile::is_enabled() || Profile::is_tracing())
+  , m_name(name)
+  , m_index(0)
+  , m_child_secs(0.0)
+  , m_parent(nullptr)
+  , m_mem_active(false)
+  , m_worker_parent(nullptr)
+  , m_worker_allocs(0)
+  , m_worker_bytes(0)
+  , m_child_peak(0) {
+  if (m_active)
+    start(name);
+}
+
+ScopedTimer::ScopedTimer(const char *name, const std::string &detail)
+  : m_active(Profile::is_enabled() || Profile::is_tracing())
+  , m_name(name)
+  , m_index(0)
+  , m_child_secs(0.0)
+  , m_parent(nullptr)
+  , m_mem_active(false)
+  , m_worker_parent(nullptr)
+  , m_worker_allocs(0)
+  , m_worker_bytes(0)
+  , m_child_peak(0) {
+  if (m_active) {
+    if (Profile::is_tracing())
+      m_detail = detail;
+    start(name);
+  }
+}
+
+void ScopedTimer::start(const char *name) {
+  m_parent = t_current_timer;
+  if (m_parent != nullptr) {
+    m_path = m_parent->m_path;
+    m_path += '/';
+  } else if (t_worker_parent != nullptr) {
+    m_worker_parent = t_worker_parent;
+    m_path = m_worker_parent->m_path;
+    m_path += '/';
+  }
+  m_path += name;
+  m_index = Profile::register_timer(m_path);
+  t_current_timer = this;
+  m_mem_active = MemStats::is_enabled();
+  if (m_mem_active)
+    MemStats::begin_phase(m_mem_phase);
+  m_start = Clock::now();
+}
+
+ScopedTimer::~ScopedTimer() {
+  if (!m_active)
+    return;
+
+  Clock::time_point end = Clock::now();
+  double secs = std::chrono::duration<double>(end - m_start).count();
+  if (m_mem_active) {
+    unsigned long allocs, bytes;
+    long peak;
+    MemStats::end_phase(m_mem_phase, allocs, bytes, peak);
+    unsigned long worker_allocs = m_worker_allocs.load(std::memory_order_relaxed);
+    unsigned long worker_bytes = m_worker_bytes.load(std::memory_order_relaxed);
+    allocs += worker_allocs;
+    bytes += worker_bytes;
+    long child_peak = m_child_peak.load(std::memory_order_relaxed);
+    if (child_peak > peak)
+      peak = child_peak;
+    Profile::record_mem(m_index, allocs, bytes, peak);
+
+    // pass on the counts that the parent's own thread didn't see
+    if (m_worker_parent != nullptr)
+      m_worker_parent->add_nested_mem(allocs, bytes, peak);
+    else if (m_parent != nullptr)
+      m_parent->add_nested_mem(worker_allocs, worker_bytes, peak);
+  }
+  Profile::record_time(m_index, secs, m_child_secs);
+  if (Profile::is_tracing())
+    Profile::record_span(m_name, m_detail, m_start, end);
+  if (m_parent != nullptr)
+    m_parent->m_child_secs += secs;
+  t_current_timer = m_parent;
+}
+
+void ScopedTimer::add_nested_mem(unsigned long worker_allocs, unsigned long worker_bytes, long peak) {
+  m_worker_allocs.fetch_add(worker_allocs, std::memory_order_relaxed);
+  m_worker_bytes.fetch_add(worker_bytes, std::memory_order_relaxed);
+  long cur = m_child_peak.load(std::memory_order_relaxed);
+  while (peak > cur && !m_child_peak.compare_exchange_weak(cur, peak, std::memory_order_relaxed))
+    ;
+}
+
+ScopedTimer *ScopedTimer::get_current() {
+  return t_current_timer;
+}
+
+WorkerTimerScope::WorkerTimerScope(ScopedTimer *parent)
+  : m_saved_parent(t_worker_parent) {
+  if (parent != nullptr)
+    t_worker_parent = parent;
+}
+
+WorkerTimerScope::~WorkerTimerScope() {
+  t_worker_parent = m_saved_parent;
+}
@@ -0,0 +1,149 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include "memstats.h"
+
+// Opt-in instrumentation for finding out where compile time goes
+// (similar to gcc's -ftime-report). When profiling is enabled,
+// ScopedTimer objects record the time spent in each phase of the
+// compilation, and the front end counts the objects it creates.
+// When profiling is disabled (the default), timers and counters
+// do nothing beyond checking a flag. If memory accounting is also
+// enabled (see memstats.h), each timer also records the allocations
+// made during its phase. If tracing is enabled, each timer also
+// records a span in a timeline, which can be written in the Chrome
+// trace event format (viewable in chrome://tracing or Perfetto).
+
+enum ProfileCounter {
+  PROF_TOKENS,
+  PROF_NODES,
+  PROF_SYMBOLS,
+  PROF_TYPES,
+  PROF_SCOPES,
+  PROF_NUM_COUNTERS,
+};
+
+class Profile {
+private:
+  static std::atomic<bool> s_enabled, s_tracing;
+  static std::atomic<unsigned long> s_counters[PROF_NUM_COUNTERS];
+
+public:
+  static bool is_enabled() { return s_enabled.load(std::memory_order_relaxed); }
+  static void set_enabled(bool enabled);
+
+  static bool is_tracing() { return s_tracing.load(std::memory_order_relaxed); }
+  static void set_tracing(bool tracing);
+
+  // increment a counter (if profiling is enabled)
+  static void count(ProfileCounter counter, unsigned long n = 1) {
+    if (is_enabled())
+      s_counters[counter].fetch_add(n, std::memory_order_relaxed);
+  }
+
+  static unsigned long get_count(ProfileCounter counter);
+  static const char *get_counter_name(ProfileCounter counter);
+
+  // discard all recorded times, counts, and trace events
+  static void reset();
+
+  // print a human-readable report
+  static void print_report(FILE *out);
+
+  // print a human-readable report of memory use per phase
+  // and per subsystem (if memory accounting is enabled)
+  static void print_mem_report(FILE *out);
+
+  // write the report as JSON to the named file
+  static void write_json(const std::string &filename);
+
+  // write the recorded trace events to the named file
+  static void write_trace(const std::string &filename);
+
+private:
+  friend class ScopedTimer;
+  static unsigned register_timer(const std::string &path);
+  static void record_time(unsigned index, double secs, double child_secs);
+  static void record_mem(unsigned index, unsigned long allocs, unsigned long bytes, long peak);
+  static void record_span(const char *name, const std::string &detail,
+                          std::chrono::steady_clock::time_point start,
+                          std::chrono::steady_clock::time_point end);
+};
+
+// A ScopedTimer measures the time from its construction until
+// it is destroyed (including by an exception). Timers nest:
+// a timer started while another is running on the same thread is
+// recorded as a child of that timer, and the report shows both
+// the total time of each timer and its "self" time excluding
+// children. Each phase or pass of the compilation should be
+// wrapped in a ScopedTimer. The optional detail (e.g., a file or
+// function name) is shown on the timer's span in a trace.
+class ScopedTimer {
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  bool m_active;
+  const char *m_name;
+  std::string m_detail;
+  std::string m_path;
+  unsigned m_index;
+  Clock::time_point m_start;
+  double m_child_secs;
+  ScopedTimer *m_parent;
+  bool m_mem_active;
+  MemPhase m_mem_phase;
+  // for an outermost timer on a worker thread, the timer on another
+  // thread that it is nested in (see WorkerTimerScope)
+  ScopedTimer *m_worker_parent;
+  // allocations made by the timers nested in this one on worker
+  // threads (which aren't counted by this thread's MemPhase), and
+  // the highest peak of the timers nested in it
+  std::atomic<unsigned long> m_worker_allocs, m_worker_bytes;
+  std::atomic<long> m_child_peak;
+
+  // value semantics prohibited
+  ScopedTimer(const ScopedTimer &);
+  ScopedTimer &operator=(const ScopedTimer &);
+
+public:
+  ScopedTimer(const char *name);
+  ScopedTimer(const char *name, const std::string &detail);
+  ~ScopedTimer();
+
+  // the innermost running timer on the current thread (if any)
+  static ScopedTimer *get_current();
+
+private:
+  friend class WorkerTimerScope;
+  void start(const char *name);
+  void add_nested_mem(unsigned long worker_allocs, unsigned long worker_bytes, long peak);
+};
+
+// While a WorkerTimerScope exists on a worker thread, the outermost
+// timers started on that thread are recorded as children of a timer
+// running on another thread (typically the one that started the
+// work), rather than as separate outermost timers. Since the worker
+// runs concurrently with the parent, its time is not subtracted from
+// the parent's self time, and the children's total time may exceed
+// the parent's. The children's allocations are added to the parent's
+// (which otherwise only counts allocations made on its own thread).
+class WorkerTimerScope {
+private:
+  ScopedTimer *m_saved_parent;
+
+  // value semantics prohibited
+  WorkerTimerScope(const WorkerTimerScope &);
+  WorkerTimerScope &operator=(const WorkerTimerScope &);
+
+public:
+  // parent may be null (if no timer was running), in which
+  // case timers are recorded as usual
+  WorkerTimerScope(ScopedTimer *parent);
+  ~WorkerTimerScope();
+};
+
+#endif // PROFILE_H
@@ -32,6 +32,7 @@ num_productions = 0
 TOKEN_START = 258   # bison token types start at 258
 first_token = true
 num_tokens = 0
+keywords = []   # pairs of [spelling, token name]
 
 header_fh = File.open('grammar_symbols.h', 'w')
 source_fh = File.open('grammar_symbols.cpp', 'w')
@@ -64,6 +65,12 @@ STDIN.each_line do |line|
     end
 
     line.split(/\s+/).each do |token|
+      if m = token.match(/^"(.*)"$/)
+        # A string alias: for keywords, this is the spelling of
+        # the keyword
+        keywords.push([m[1], grammar_symbol_names.last])
+        next
+      end
       grammar_symbol_names.push(token)
       header_fh.print "  NODE_#{token}"
       header_fh.print " = #{TOKEN_START}" if first_token
@@ -77,6 +84,11 @@ end
 header_fh.print <<"EOF2"
 };
 
+// If the len characters starting at s are a keyword, return the
+// keyword's token tag, otherwise return 0. This is used by the lexers
+// to recognize keywords, which are first matched as identifiers.
+int lookup_keyword(const char *s, unsigned len);
+
 // Get grammar symbol name corresponding to tag (enumeration value).
 // Useful for making sense of a parse tree based on the tag values
 // of the nodes.
@@ -94,7 +106,68 @@ public:
 #endif // GRAMMAR_SYMBOLS_H
 EOF2
 
+# Find a minimal perfect hash function for the keywords, using the
+# "hash, displace" method: each keyword is hashed (FNV-1a, with a seed
+# as the initial value) to a bucket, and each bucket has a displacement
+# which is added to a second value derived from the hash to get the
+# keyword's slot. The buckets are placed largest first, trying
+# displacements until all of the bucket's keywords land in empty slots.
+# If that fails, another seed is tried. The table of keywords has
+# exactly one slot per keyword.
+
+def keyword_hash(word, seed)
+  h = seed
+  word.each_byte do |c|
+    h = ((h ^ c) * 16777619) & 0xffffffff
+  end
+  return h
+end
+
+def find_perfect_hash(words)
+  n = words.length
+  num_buckets = [(n + 1) / 2, 1].max
+  (1..100000).each do |attempt|
+    seed = (2166136261 + attempt * 40503) & 0xffffffff
+    buckets = Array.new(num_buckets) { [] }
+    words.each do |w|
+      h = keyword_hash(w, seed)
+      buckets[h % num_buckets].push(h >> 8)
+    end
+
+    slots = Array.new(n, false)
+    disp = Array.new(num_buckets, 0)
+    ok = true
+    (0...num_buckets).sort_by { |b| [-buckets[b].length, b] }.each do |b|
+      next if buckets[b].empty?
+      d = (0...n).find do |d|
+        positions = buckets[b].map { |h2| (h2 + d) % n }
+        positions.uniq.length == positions.length && positions.none? { |p| slots[p] }
+      end
+      if d.nil?
+        ok = false
+        break
+      end
+      buckets[b].each { |h2| slots[(h2 + d) % n] = true }
+      disp[b] = d
+    end
+
+    return [seed, disp] if ok
+  end
+  raise "Couldn't find a perfect hash function for the keywords"
+end
+
+keyword_seed, keyword_disp = find_perfect_hash(keywords.map { |kw| kw[0] })
+keyword_slots = Array.new(keywords.length)
+keywords.each do |kw|
+  h = keyword_hash(kw[0], keyword_seed)
+  keyword_slots[((h >> 8) + keyword_disp[h % keyword_disp.length]) % keywords.length] = kw
+end
+min_keyword_len = keywords.map { |kw| kw[0].length }.min
+max_keyword_len = keywords.map { |kw| kw[0].length }.max
+
 source_fh.print <<"EOF3"
+#include <cstring>
+#include <cstdint>
 #include "grammar_symbols.h"
 
 namespace {
@@ -130,6 +203,49 @@ const char *get_grammar_symbol_name(int tag) {
   return s_grammar_symbol_names[#{num_tokens} + which_production];
 }
 
+namespace {
+struct KeywordEntry {
+  const char *name;
+  unsigned len;
+  int tag;
+};
+
+// keywords, in the slots assigned by the perfect hash function
+const KeywordEntry s_keywords[] = {
+EOF4
+keyword_slots.each do |kw|
+  source_fh.puts "  { \"#{kw[0]}\", #{kw[0].length}, NODE_#{kw[1]} },"
+end
+source_fh.print <<"EOF5"
+};
+
+// displacement for each hash bucket
+const unsigned s_keyword_disp[] = {
+EOF5
+keyword_disp.each_slice(8) do |slice|
+  source_fh.puts "  #{slice.join(', ')},"
+end
+source_fh.print <<"EOF6"
+};
+}
+
+int lookup_keyword(const char *s, unsigned len) {
+  if (len < #{min_keyword_len} || len > #{max_keyword_len}) {
+    return 0;
+  }
+
+  uint32_t h = #{keyword_seed}U;
+  for (unsigned i = 0; i < len; ++i) {
+    h = (h ^ (unsigned char) s[i]) * 16777619U;
+  }
+
+  const KeywordEntry &kw = s_keywords[((h >> 8) + s_keyword_disp[h % #{keyword_disp.length}]) % #{keywords.length}];
+  if (kw.len == len && memcmp(kw.name, s, len) == 0) {
+    return kw.tag;
+  }
+  return 0;
+}
+
 ParseTreePrint::ParseTreePrint() {
 }
 
@@ -139,7 +255,7 @@ ParseTreePrint::~ParseTreePrint() {
 std::string ParseTreePrint::node_tag_to_string(int tag) const {
   return std::string(get_grammar_symbol_name(tag));
 }
-EOF4
+EOF6
 
 header_fh.close
 source_fh.close
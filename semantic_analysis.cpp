@@ -1,21 +1,48 @@
 #include <cassert>
+#include <cstdarg>
 #include <algorithm>
 #include <utility>
 #include <map>
+#include <exception>
 #include "grammar_symbols.h"
 #include "parse.tab.h"
 #include "node.h"
 #include "ast.h"
 #include "exceptions.h"
+#include "cpputil.h"
+#include "diagnostics.h"
 #include "semantic_analysis.h"
+#include "ast_stats.h"
+#include "profile.h"
+#include "task_pool.h"
 
 SemanticAnalysis::SemanticAnalysis()
-  : m_global_symtab(new SymbolTable(nullptr)) {
+  : m_global_symtab(new SymbolTable(nullptr))
+  , m_stats(nullptr)
+  , m_diags(nullptr)
+  , m_owns_global_symtab(true) {
+  m_cur_symtab = m_global_symtab;
+}
+
+SemanticAnalysis::SemanticAnalysis(SymbolTable *global_symtab, ASTStats *stats, Diagnostics *diags)
+  : m_global_symtab(global_symtab)
+  , m_stats(stats)
+  , m_diags(diags)
+  , m_owns_global_symtab(false) {
   m_cur_symtab = m_global_symtab;
 }
 
 SemanticAnalysis::~SemanticAnalysis() {
-  delete(m_cur_symtab);
+  // if analysis was abandoned due to an error, there may still
+  // be nested scopes to clean up (they aren't recorded in the
+  // statistics, which may no longer exist)
+  while (m_cur_symtab != m_global_symtab) {
+    SymbolTable *table = m_cur_symtab;
+    m_cur_symtab = m_cur_symtab->get_parent();
+    delete(table);
+  }
+  if (m_owns_global_symtab)
+    delete(m_global_symtab);
 }
 
 int debug = 0;
@@ -25,7 +52,9 @@ void SemanticAnalysis::visit_struct_type(Node *n) {
   std::string name = "struct " + n->get_kid(0)->get_str();
   Symbol *target = m_cur_symtab->lookup_recursive_kind(name, SymbolKind::TYPE);
   if(!target){
-    SemanticError::raise(n->get_loc(), "No such struct visit_struct_type");
+    error(n->get_loc(), "No such struct visit_struct_type");
+    n->set_type(error_type());
+    return;
   }
   n->set_type(target->get_type());
 }
@@ -42,18 +71,23 @@ void SemanticAnalysis::visit_variable_declaration(Node *n) {
   //kid 2 = declarator(optional pointer + var name) list
   //construct complete type rep
   visit(n->get_kid(1));
-  std::shared_ptr<Type> base_type = n->get_kid(1)->get_type();
+  const std::shared_ptr<Type> &base_type = n->get_kid(1)->get_type();
   Node *decl_list = n->get_kid(2);
   // for each 
   for(auto i = decl_list->cbegin(); i != decl_list->cend(); ++i){
     Node *declarator = *i;
     std::shared_ptr<Type> base_type1 = base_type;
     std::string name = build_type(declarator, base_type1);
+    // uses of a variable with an erroneous type are errors too
+    if(base_type->is_error()){
+      base_type1 = base_type;
+    }
     // printf("name: %s\n", base_type1->as_str().c_str());
     if(m_cur_symtab->has_symbol_local(name)){
-      SemanticError::raise(declarator->get_kid(0)->get_loc(), "Already defined");
+      error(declarator->get_kid(0)->get_loc(), "Already defined");
+    }else{
+      m_cur_symtab->declare(SymbolKind::VARIABLE, name, base_type1);
     }
-    m_cur_symtab->declare(SymbolKind::VARIABLE, name, base_type1);
     declarator->set_type(base_type1);
     declarator->set_str(name);
   }
@@ -75,7 +109,9 @@ void SemanticAnalysis::visit_basic_type(Node *n) {
         if(is_signed == -1){
           is_signed = 1;
         }else{
-          SemanticError::raise(n->get_loc(), "Too many signed/unsigned");
+          error(n->get_loc(), "Too many signed/unsigned");
+          n->set_type(error_type());
+          return;
         }
         break;
       }
@@ -83,7 +119,9 @@ void SemanticAnalysis::visit_basic_type(Node *n) {
         if(is_signed == -1){
           is_signed = 0;
         }else{
-          SemanticError::raise(n->get_loc(), "Too many signed/unsigned");
+          error(n->get_loc(), "Too many signed/unsigned");
+          n->set_type(error_type());
+          return;
         }
         break;
       }
@@ -91,7 +129,9 @@ void SemanticAnalysis::visit_basic_type(Node *n) {
         if(type_kind == BasicTypeKind::NOTHING){
           type_kind = BasicTypeKind::CHAR;
         }else{
-          SemanticError::raise(n->get_loc(), "Cannot be more than char at a time");
+          error(n->get_loc(), "Cannot be more than char at a time");
+          n->set_type(error_type());
+          return;
         }
         break;
       }
@@ -99,7 +139,9 @@ void SemanticAnalysis::visit_basic_type(Node *n) {
         if(type_kind == BasicTypeKind::NOTHING || type_kind == BasicTypeKind::INT){
           type_kind = BasicTypeKind::SHORT;
         }else{
-          SemanticError::raise(n->get_loc(), "Cannot be more than short at a time");
+          error(n->get_loc(), "Cannot be more than short at a time");
+          n->set_type(error_type());
+          return;
         }
         break;
       }
@@ -108,7 +150,9 @@ void SemanticAnalysis::visit_basic_type(Node *n) {
           type_kind = BasicTypeKind::INT;
         }else if(type_kind == BasicTypeKind::SHORT || type_kind == BasicTypeKind::LONG){
         }else{
-          SemanticError::raise(n->get_loc(), "Cannot be more than int at a time");
+          error(n->get_loc(), "Cannot be more than int at a time");
+          n->set_type(error_type());
+          return;
         }
         break;
       }
@@ -116,7 +160,9 @@ void SemanticAnalysis::visit_basic_type(Node *n) {
         if(type_kind == BasicTypeKind::NOTHING || type_kind == BasicTypeKind::INT){
           type_kind = BasicTypeKind::LONG;
         }else{
-          SemanticError::raise(n->get_loc(), "Cannot be more than long at a time");
+          error(n->get_loc(), "Cannot be more than long at a time");
+          n->set_type(error_type());
+          return;
         }
         break;
       }
@@ -124,7 +170,9 @@ void SemanticAnalysis::visit_basic_type(Node *n) {
         if(type_kind == BasicTypeKind::NOTHING){
           type_kind = BasicTypeKind::VOID;
         }else{
-          SemanticError::raise(n->get_loc(), "Cannot be more than void at a time");
+          error(n->get_loc(), "Cannot be more than void at a time");
+          n->set_type(error_type());
+          return;
         }
         break;
       }
@@ -132,7 +180,9 @@ void SemanticAnalysis::visit_basic_type(Node *n) {
         if(is_const == TypeQualifier::NOTHING){
           is_const = TypeQualifier::CONST;
         }else{
-          SemanticError::raise(n->get_loc(), "Too many const");
+          error(n->get_loc(), "Too many const");
+          n->set_type(error_type());
+          return;
         }
         break;
       }
@@ -140,7 +190,9 @@ void SemanticAnalysis::visit_basic_type(Node *n) {
         if(is_volatile == TypeQualifier::NOTHING){
           is_volatile = TypeQualifier::VOLATILE;
         }else{
-          SemanticError::raise(n->get_loc(), "Too many volatile");
+          error(n->get_loc(), "Too many volatile");
+          n->set_type(error_type());
+          return;
         }
         break;
       }
@@ -153,7 +205,9 @@ void SemanticAnalysis::visit_basic_type(Node *n) {
     type_kind = BasicTypeKind::INT;
   }
   if(type_kind == BasicTypeKind::VOID && (is_signed != -1 || is_const != TypeQualifier::NOTHING || is_volatile != TypeQualifier::NOTHING)){
-    SemanticError::raise(n->get_loc(), "Void cannot be signed/unsigned and(or) qualified");
+    error(n->get_loc(), "Void cannot be signed/unsigned and(or) qualified");
+    n->set_type(error_type());
+    return;
   }
   
   // Basic type creation
@@ -176,6 +230,13 @@ void SemanticAnalysis::visit_basic_type(Node *n) {
 void SemanticAnalysis::visit_function_definition(Node *n) {
   // TODO: implement
   if(debug){puts("visit_function_definition");}
+  std::shared_ptr<Type> func_type = declare_function(n);
+  check_function_body(n, func_type);
+}
+
+// Build the type of a function definition and add it to the current
+// scope, returning the function type
+std::shared_ptr<Type> SemanticAnalysis::declare_function(Node *n) {
   // get basic type 
   visit(n->get_kid(0));
   std::shared_ptr<Type> func_type(new FunctionType(n->get_kid(0)->get_type()));
@@ -194,24 +255,48 @@ void SemanticAnalysis::visit_function_definition(Node *n) {
   }
   
   // Sanity check for function
+  // (a function that was previously declared, e.g. by an imported
+  // interface file, is now defined, and its body still needs checking,
+  // but only if the definition agrees with the declaration)
   if(m_cur_symtab->has_symbol_local(name)){
-    if(m_cur_symtab->lookup_local(name)->is_defined()){
-      SemanticError::raise(n->get_loc(), "Cannot redefine function %s", name.c_str());
+    Symbol *existing = m_cur_symtab->lookup_local(name);
+    if(existing->get_kind() != SymbolKind::FUNCTION || !existing->get_type()->is_same(func_type.get())){
+      error(n->get_loc(), "Conflicting declaration of function %s", name.c_str());
+    }else if(existing->is_defined()){
+      error(n->get_loc(), "Cannot redefine function %s", name.c_str());
     }else{
-      m_cur_symtab->lookup_local(name)->set_is_defined(true);
-      leave_scope();
-      return;
+      existing->set_is_defined(true);
     }
+  }else{
+    m_cur_symtab->define(SymbolKind::FUNCTION, name, func_type);
   }
-  m_cur_symtab->define(SymbolKind::FUNCTION, name, func_type);
-  
+
+  return func_type;
+}
+
+// Check the parameters and body of a function definition (after
+// declare_function). When the body is checked on a worker thread,
+// num_globals_visible is the number of global symbols that had been
+// declared when the function was reached, and print_buffer is where
+// the symbol table entries are printed.
+void SemanticAnalysis::check_function_body(Node *n, const std::shared_ptr<Type> &func_type,
+                                           unsigned num_globals_visible, std::string *print_buffer) {
+  std::string name = n->get_kid(1)->get_str();
+  ScopedTimer timer("function", name);
+
+  Node *param_list = n->get_kid(2);
+
   // new scope for func param, and add them to table, apparently order matters
   enter_scope();
+  m_cur_symtab->set_num_parent_symbols_visible(num_globals_visible);
+  if (print_buffer != nullptr)
+    m_cur_symtab->set_print_buffer(print_buffer);
   for(auto i = param_list->cbegin(); i != param_list->cend(); ++i){
     Node *param = *i;
     std::string param_name = param->get_kid(1)->get_str();
     if(m_cur_symtab->has_symbol_local(param_name)){
-      SemanticError::raise(param->get_kid(1)->get_loc(), "Cannot have duplicate names");
+      error(param->get_kid(1)->get_loc(), "Cannot have duplicate names");
+      continue;
     }
     m_cur_symtab->declare(SymbolKind::VARIABLE, param_name, param->get_kid(1)->get_type());
 
@@ -221,6 +306,9 @@ void SemanticAnalysis::visit_function_definition(Node *n) {
   visit(n->get_kid(3));
   leave_scope();
   leave_scope();
+
+  // the types in the function's scopes are no longer needed
+  m_type_compat.clear();
 }
 
 void SemanticAnalysis::visit_function_declaration(Node *n) {
@@ -245,7 +333,8 @@ void SemanticAnalysis::visit_function_declaration(Node *n) {
   
   // Func type sanity check
   if(m_cur_symtab->has_symbol_local(name)){
-      SemanticError::raise(n->get_loc(), "Cannot redeclaration function %s", name.c_str());
+      error(n->get_loc(), "Cannot redeclaration function %s", name.c_str());
+      return;
   }
   m_cur_symtab->declare(SymbolKind::FUNCTION, name, func_type);
 }
@@ -254,9 +343,12 @@ void SemanticAnalysis::visit_function_parameter(Node *n) {
   // TODO: solution
   if(debug){puts("visit_function_parameter");}
   visit(n->get_kid(0));
-  std::shared_ptr<Type> base_type = n->get_kid(0)->get_type();
+  const std::shared_ptr<Type> &base_type = n->get_kid(0)->get_type();
   std::shared_ptr<Type> base_type1 = base_type;
   std::string name = build_type(n->get_kid(1), base_type1);
+  if(base_type->is_error()){
+    base_type1 = base_type;
+  }
   n->get_kid(1)->set_type(base_type1);
   n->get_kid(1)->set_str(name);
 }
@@ -275,7 +367,8 @@ void SemanticAnalysis::visit_struct_type_definition(Node *n) {
   std::string name = n->get_kid(0)->get_str();
 
   if(m_cur_symtab->has_symbol_local("struct " + name)){
-    SemanticError::raise(n->get_loc(), "Cannot redefine struct %s", name.c_str());
+    error(n->get_loc(), "Cannot redefine struct %s", name.c_str());
+    return;
   }
   std::shared_ptr<Type> s_type(new StructType(name));
   m_cur_symtab->define(SymbolKind::TYPE, "struct " + name, s_type);
@@ -300,39 +393,71 @@ void SemanticAnalysis::visit_struct_type_definition(Node *n) {
 }
 
 void SemanticAnalysis::visit_binary_expression(Node *n) {
-  // TODO: implement
+  // Chains of left-associative operators (a + b + c + ...) nest in
+  // the left operand. The chain is followed iteratively, and then the
+  // operators are checked from the innermost one out, so that a long
+  // chain doesn't need one C++ stack frame per operator.
+  std::vector<Node *>::size_type mark = m_binary_chain.size();
+  Node *operand = n;
+  while (operand->get_tag() == AST_BINARY_EXPRESSION) {
+    m_binary_chain.push_back(operand);
+    operand = operand->get_kid(1);
+  }
+  visit(operand);
+  while (m_binary_chain.size() > mark) {
+    Node *expr = m_binary_chain.back();
+    m_binary_chain.pop_back();
+    check_binary_expression(expr);
+  }
+}
+
+// Check a binary expression whose left operand has been visited
+void SemanticAnalysis::check_binary_expression(Node *n) {
   if(debug){puts("visit_binary_expression");}
 
   //Operator
   int tag = n->get_kid(0)->get_tag();
   //lvalue
-  visit(n->get_kid(1));
-  std::shared_ptr<Type> l_type = n->get_kid(1)->get_type();
+  const std::shared_ptr<Type> &l_type = n->get_kid(1)->get_type();
   std::string l_name = n->get_kid(1)->get_str();
   //rvalue
   visit(n->get_kid(2));
-  std::shared_ptr<Type> r_type = n->get_kid(2)->get_type();
+  const std::shared_ptr<Type> &r_type = n->get_kid(2)->get_type();
+
+  // an error has already been reported for the operand
+  if(l_type->is_error() || r_type->is_error()){
+    n->set_type(error_type());
+    return;
+  }
 
   switch(tag){
     //For assignment
     case TOK_ASSIGN:{
       //check if lvalue
       if(!l_type->is_lvalue() || n->get_kid(1)->get_value_type() == ValueType::COMPUTED){
-        SemanticError::raise(n->get_loc(), "Cannot assign to non-lvalue");
+        error(n->get_loc(), "Cannot assign to non-lvalue");
+        n->set_type(error_type());
+        return;
       }
       //cannot assign to const
       else if(l_type->is_const()){
-        SemanticError::raise(n->get_loc(), "Cannot assign (%s) to (const)", r_type->as_str().c_str());
+        error(n->get_loc(), "Cannot assign (%s) to (const)", r_type->as_str().c_str());
+        n->set_type(error_type());
+        return;
       }
       //for pointer
       else if(l_type->is_pointer() && r_type->is_pointer()){
-        if(!comp_ptr(l_type, r_type)){
-          SemanticError::raise(n->get_loc(), "Cannot assign (%s) to (%s)", r_type->as_str().c_str(), l_type->as_str().c_str());
+        if(m_type_compat.convert_pointer(l_type, r_type) == Conversion::NONE){
+          error(n->get_loc(), "Cannot assign (%s) to (%s)", r_type->as_str().c_str(), l_type->as_str().c_str());
+          n->set_type(error_type());
+          return;
         }
       }
       else{
-        if(!is_convertible(l_type, r_type)){
-          SemanticError::raise(n->get_loc(), "Cannot assign (%s) to (%s)", r_type->as_str().c_str(), l_type->as_str().c_str());
+        if(m_type_compat.convert(l_type, r_type) == Conversion::NONE){
+          error(n->get_loc(), "Cannot assign (%s) to (%s)", r_type->as_str().c_str(), l_type->as_str().c_str());
+          n->set_type(error_type());
+          return;
         }
       }
       break;
@@ -341,7 +466,9 @@ void SemanticAnalysis::visit_binary_expression(Node *n) {
     case TOK_ASTERISK:
     case TOK_MOD:{
       if(l_type->is_pointer() || r_type->is_pointer()){
-        SemanticError::raise(n->get_loc(), "Pointer arithmatic not allowed visit_binary_expression");
+        error(n->get_loc(), "Pointer arithmatic not allowed visit_binary_expression");
+        n->set_type(error_type());
+        return;
       }
     }
     case TOK_LOGICAL_AND:
@@ -360,7 +487,9 @@ void SemanticAnalysis::visit_binary_expression(Node *n) {
         // n->set_type(r_type);
       }else if(r_type->is_integral() && l_type->is_pointer()){
       }else{
-        SemanticError::raise(n->get_loc(), "Cannot perform such binary operation");
+        error(n->get_loc(), "Cannot perform such binary operation");
+        n->set_type(error_type());
+        return;
       }
       break;
     }
@@ -376,10 +505,16 @@ void SemanticAnalysis::visit_unary_expression(Node *n) {
   // TODO: implement
   if(debug){puts("visit_unary_expression");}
   visit(n->get_kid(1));
+  if(n->get_kid(1)->get_type()->is_error()){
+    n->set_type(error_type());
+    return;
+  }
   switch(n->get_kid(0)->get_tag()){
     case TOK_ASTERISK:{
       if(!n->get_kid(1)->get_type()->is_pointer()){
-        SemanticError::raise(n->get_loc(), "Cannot dereference a non-pointer");
+        error(n->get_loc(), "Cannot dereference a non-pointer");
+        n->set_type(error_type());
+        return;
       }
       //set type as dereferenced
       n->set_type(n->get_kid(1)->get_type()->get_base_type());
@@ -389,7 +524,9 @@ void SemanticAnalysis::visit_unary_expression(Node *n) {
     case TOK_AMPERSAND:{
       // !m_cur_symtab->lookup_recursive(n->get_kid(1)->get_str())
       if(!n->get_kid(1)->get_type()->is_lvalue()){
-        SemanticError::raise(n->get_loc(), "Cannot get address of non-lvalue");
+        error(n->get_loc(), "Cannot get address of non-lvalue");
+        n->set_type(error_type());
+        return;
       }
       //set type as pointer
       std::shared_ptr<Type> pointer(new PointerType(n->get_kid(1)->get_type()));
@@ -399,7 +536,9 @@ void SemanticAnalysis::visit_unary_expression(Node *n) {
     }
     default:{
       if(n->get_kid(1)->get_type()->is_pointer()){
-        SemanticError::raise(n->get_loc(), "Cannot perform operation on pointer");
+        error(n->get_loc(), "Cannot perform operation on pointer");
+        n->set_type(error_type());
+        return;
       }
       n->set_type(n->get_kid(1)->get_type());
       break;
@@ -407,19 +546,34 @@ void SemanticAnalysis::visit_unary_expression(Node *n) {
   }
 }
 
+// The following only determine the type of the expression (so that
+// analysis of the enclosing expression can continue), without
+// checking the operands
+
 void SemanticAnalysis::visit_postfix_expression(Node *n) {
-  // TODO: implement
   if(debug){puts("visit_postfix_expression");}
+  visit(n->get_kid(1));
+  n->set_value_type(ValueType::COMPUTED);
+  n->set_type(n->get_kid(1)->get_type());
 }
 
 void SemanticAnalysis::visit_conditional_expression(Node *n) {
-  // TODO: implement
   if(debug){puts("visit_conditional_expression");}
+  visit_children(n);
+  n->set_value_type(ValueType::COMPUTED);
+  if(n->get_kid(0)->get_type()->is_error() || n->get_kid(2)->get_type()->is_error()){
+    n->set_type(error_type());
+    return;
+  }
+  n->set_type(n->get_kid(1)->get_type());
 }
 
 void SemanticAnalysis::visit_cast_expression(Node *n) {
-  // TODO: implement
   if(debug){puts("visit_cast_expression");}
+  // kid 1 is the type
+  visit(n->get_kid(1));
+  n->set_value_type(ValueType::COMPUTED);
+  n->set_type(n->get_kid(1)->get_type());
 }
 
 void SemanticAnalysis::visit_function_call_expression(Node *n) {
@@ -433,18 +587,28 @@ void SemanticAnalysis::visit_function_call_expression(Node *n) {
   int arg_cnt = arg_list_node->get_num_kids();
   Symbol *sym = m_cur_symtab->lookup_recursive_kind(func_name, SymbolKind::FUNCTION);
   if(sym == nullptr){
-    SemanticError::raise(n->get_loc(), "Function %s not declared/defined", func_name.c_str());
+    error(n->get_loc(), "Function %s not declared/defined", func_name.c_str());
+    n->set_type(error_type());
+    return;
   }
-  std::shared_ptr<Type> func_type = sym->get_type();
+  const std::shared_ptr<Type> &func_type = sym->get_type();
   if(func_type->get_num_members() != arg_cnt){
-    SemanticError::raise(n->get_loc(), "Function %s number of arguments does not match", func_name.c_str());
+    error(n->get_loc(), "Function %s number of arguments does not match", func_name.c_str());
+    n->set_type(error_type());
+    return;
   }
   for(int i = 0; i < arg_cnt; i++){
     Node *param = arg_list_node->get_kid(i);
     visit(param);
 
-    if(!is_convertible(param->get_type(), func_type->get_member(i).get_type())){
-      SemanticError::raise(param->get_loc(), "Argument type does not match");
+    // (the error was already reported if either the argument
+    // or the parameter has the error type)
+    const std::shared_ptr<Type> &param_type = func_type->get_member(i).get_type();
+    if(param->get_type()->is_error() || param_type->is_error()){
+      continue;
+    }
+    if(m_type_compat.convert(param->get_type(), param_type) == Conversion::NONE){
+      error(param->get_loc(), "Argument type does not match");
     }
   }
   n->set_type(func_type->get_base_type());
@@ -459,15 +623,21 @@ void SemanticAnalysis::visit_field_ref_expression(Node *n) {
   // if(!m_cur_symtab->lookup_recursive_kind(l_name, SymbolKind::VARIABLE)){
   //   SemanticError::raise(n->get_loc(), "%s not declared visit_field_ref_expression", l_name.c_str());
   // }
-  std::shared_ptr<Type> l_type = n->get_kid(0)->get_type();
+  const std::shared_ptr<Type> &l_type = n->get_kid(0)->get_type();
   // printf("type : %s\n", l_type->as_str().c_str());
+  if(l_type->is_error()){
+    n->set_type(error_type());
+    return;
+  }
   if(!(l_type->is_struct())){
-    SemanticError::raise(n->get_loc(), "Cannot use . on non-struct");
+    error(n->get_loc(), "Cannot use . on non-struct");
+    n->set_type(error_type());
+    return;
   }
   std::string r_name = n->get_kid(1)->get_str();
   for(int i = 0; i < l_type->get_num_members(); i++){
-    Member m = l_type->get_member(i);
-    std::string m_name = m.get_name();
+    const Member &m = l_type->get_member(i);
+    const std::string &m_name = m.get_name();
     // printf("member : %s\n", m_name.c_str());
     if(r_name == m_name){
       // printf("is l? %d\n", m.get_type()->is_lvalue());
@@ -475,7 +645,8 @@ void SemanticAnalysis::visit_field_ref_expression(Node *n) {
       return;
     }
   }
-  SemanticError::raise(n->get_loc(), "%s not declared visit_field_ref_expression", r_name.c_str());
+  error(n->get_loc(), "%s not declared visit_field_ref_expression", r_name.c_str());
+  n->set_type(error_type());
 }
 
 void SemanticAnalysis::visit_indirect_field_ref_expression(Node *n) {
@@ -485,24 +656,31 @@ void SemanticAnalysis::visit_indirect_field_ref_expression(Node *n) {
   visit(n->get_kid(0));
   std::string l_name = n->get_kid(0)->get_str();
 
-  std::shared_ptr<Type> l_type = n->get_kid(0)->get_type();
+  const std::shared_ptr<Type> &l_type = n->get_kid(0)->get_type();
   std::string r_name = n->get_kid(1)->get_str();
+  if(l_type->is_error()){
+    n->set_type(error_type());
+    return;
+  }
   //Make sure lvalue is pointer to struct
   if(!(l_type->is_pointer() && l_type->get_base_type()->is_struct())){
-    SemanticError::raise(n->get_loc(), "Cannot use -> on non-(struct pointer)");
+    error(n->get_loc(), "Cannot use -> on non-(struct pointer)");
+    n->set_type(error_type());
+    return;
   }
   //Check if struct has field
   //first dereference the pointer to struct
-  l_type = l_type->get_base_type();
-  for(int i = 0; i < l_type->get_num_members(); i++){
-    Member m = l_type->get_member(i);
-    std::string m_name = m.get_name();
+  const std::shared_ptr<Type> &struct_type = l_type->get_base_type();
+  for(int i = 0; i < struct_type->get_num_members(); i++){
+    const Member &m = struct_type->get_member(i);
+    const std::string &m_name = m.get_name();
     if(r_name == m_name){
       n->set_type(m.get_type());
       return;
     }
   }
-  SemanticError::raise(n->get_loc(), "%s not declared", l_name.c_str());
+  error(n->get_loc(), "%s not declared", l_name.c_str());
+  n->set_type(error_type());
 }
 
 void SemanticAnalysis::visit_array_element_ref_expression(Node *n) {
@@ -510,9 +688,15 @@ void SemanticAnalysis::visit_array_element_ref_expression(Node *n) {
   if(debug){puts("visit_array_element_ref_expression");}
   visit(n->get_kid(0));
   visit(n->get_kid(1));
+  if(n->get_kid(0)->get_type()->is_error() || n->get_kid(1)->get_type()->is_error()){
+    n->set_type(error_type());
+    return;
+  }
   //make sure the array index is numeric
   if(!n->get_kid(1)->get_type()->is_integral()){
-    SemanticError::raise(n->get_loc(), "Cannot access non-integral index");
+    error(n->get_loc(), "Cannot access non-integral index");
+    n->set_type(error_type());
+    return;
   }
   n->set_str(n->get_kid(0)->get_str());
   //equivalent to *(a+i), get_base_type is similar to deferencing
@@ -526,7 +710,9 @@ void SemanticAnalysis::visit_variable_ref(Node *n) {
   std::string name = n->get_kid(0)->get_str();
   Symbol *v_symbol = m_cur_symtab->lookup_recursive(name);
   if(!v_symbol){
-    SemanticError::raise(n->get_loc(), "%s not declared", name.c_str());
+    error(n->get_loc(), "%s not declared", name.c_str());
+    n->set_type(error_type());
+    return;
   }
   n->set_type(v_symbol->get_type());
   n->set_str(n->get_kid(0)->get_str());
@@ -567,8 +753,12 @@ void SemanticAnalysis::visit_literal_value(Node *n) {
 void SemanticAnalysis::visit_return_expression_statement(Node *n){
   if(debug){puts("visit_return_expression_statement");}
   visit(n->get_kid(0));
-  if(!is_convertible(n->get_kid(0)->get_type(), m_cur_symtab->get_fn_type()->get_base_type())){
-    SemanticError::raise(n->get_loc(), "Does not match function return type");
+  const std::shared_ptr<Type> &return_type = m_cur_symtab->get_fn_type()->get_base_type();
+  if(n->get_kid(0)->get_type()->is_error() || return_type->is_error()){
+    return;
+  }
+  if(m_type_compat.convert(n->get_kid(0)->get_type(), return_type) == Conversion::NONE){
+    error(n->get_loc(), "Does not match function return type");
   }
   
 }
@@ -622,6 +812,148 @@ void SemanticAnalysis::visit_if_else_statement(Node *n){
 }
 
 // TODO: implement helper functions
+namespace {
+
+// Results of analyzing one top-level declaration with analyze_unit()
+struct DeclResult {
+  std::string output;             // symbol table entries for the declaration
+  Diagnostics errors;             // errors recorded for the declaration
+  std::exception_ptr error;       // error thrown (if any)
+  std::string body_output;        // same, for the function body (if any)
+  Diagnostics body_errors;
+  std::exception_ptr body_error;
+};
+
+// A function body to be checked on a worker thread
+struct FunctionBody {
+  Node *n;
+  std::shared_ptr<Type> func_type;
+  unsigned num_globals_visible;
+  unsigned index;                 // index of the declaration in the unit
+};
+
+void write_output(const std::string &output) {
+  fwrite(output.data(), 1, output.size(), stdout);
+}
+
+}
+
+void SemanticAnalysis::analyze_unit(Node *unit, unsigned num_jobs) {
+  unsigned num_decls = unit->get_num_kids();
+
+  if (num_jobs <= 1) {
+    for (unsigned i = 0; i < num_decls && !error_limit_reached(); ++i)
+      visit(unit->get_kid(i));
+    return;
+  }
+
+  std::vector<DeclResult> results(num_decls);
+  std::vector<FunctionBody> bodies;
+
+  // Errors are recorded separately for each declaration and function
+  // body, and combined in source order at the end
+  unsigned max_errors = (m_diags != nullptr) ? m_diags->get_max_errors() : 0;
+  unsigned num_errors = 0;
+  Diagnostics *diags = m_diags;
+
+  // Phase 1: analyze the top-level declarations in order, stopping
+  // at the first error thrown (or when the error limit is reached).
+  // For function definitions, only the function itself is declared.
+  unsigned num_analyzed = 0;
+  while (num_analyzed < num_decls && (max_errors == 0 || num_errors < max_errors)) {
+    Node *decl = unit->get_kid(num_analyzed);
+    DeclResult &result = results[num_analyzed];
+    ++num_analyzed;
+
+    m_global_symtab->set_print_buffer(&result.output);
+    result.errors.set_max_errors(max_errors);
+    if (diags != nullptr)
+      m_diags = &result.errors;
+    try {
+      if (decl->get_tag() == AST_FUNCTION_DEFINITION) {
+        FunctionBody body;
+        body.n = decl;
+        body.func_type = declare_function(decl);
+        body.num_globals_visible = m_global_symtab->get_num_symbols();
+        body.index = num_analyzed - 1;
+        bodies.push_back(body);
+      } else {
+        visit(decl);
+      }
+    } catch (...) {
+      result.error = std::current_exception();
+    }
+    m_diags = diags;
+    if (result.error)
+      break;
+    num_errors += result.errors.get_num_errors();
+  }
+  m_global_symtab->set_print_buffer(nullptr);
+
+  // Phase 2: check the function bodies in parallel. Each task has
+  // its own scopes, nested in the global scope, which is not modified.
+  // The tasks' timers are nested in the timer running on this thread.
+  ScopedTimer *parent_timer = ScopedTimer::get_current();
+  TaskPool pool(num_jobs);
+  pool.run(unsigned(bodies.size()), [&](unsigned i) {
+    WorkerTimerScope timer_scope(parent_timer);
+    const FunctionBody &body = bodies[i];
+    DeclResult &result = results[body.index];
+    result.body_errors.set_max_errors(max_errors);
+    SemanticAnalysis body_sema(m_global_symtab, m_stats, (diags != nullptr) ? &result.body_errors : nullptr);
+    try {
+      body_sema.check_function_body(body.n, body.func_type, body.num_globals_visible, &result.body_output);
+    } catch (...) {
+      result.body_error = std::current_exception();
+    }
+  });
+
+  // Phase 3: produce the output and errors in source order, stopping
+  // where a sequential analysis would have stopped: at the first error
+  // thrown, or at the end of the declaration in which the error limit
+  // was reached
+  for (unsigned i = 0; i < num_analyzed && !error_limit_reached(); ++i) {
+    const DeclResult &result = results[i];
+    write_output(result.output);
+    if (diags != nullptr)
+      diags->append(result.errors);
+    if (result.error)
+      std::rethrow_exception(result.error);
+    write_output(result.body_output);
+    if (diags != nullptr)
+      diags->append(result.body_errors);
+    if (result.body_error)
+      std::rethrow_exception(result.body_error);
+  }
+}
+
+// Report an error: if there is a Diagnostics object, the error is
+// recorded there, and the caller is expected to recover (typically
+// by giving the node the error type)
+void SemanticAnalysis::error(const Location &loc, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  if (m_diags == nullptr) {
+    std::string msg = cpputil::vformat(fmt, args);
+    va_end(args);
+    throw SemanticError(loc, msg);
+  }
+  m_diags->verror(loc, fmt, args);
+  va_end(args);
+}
+
+bool SemanticAnalysis::error_limit_reached() const {
+  return m_diags != nullptr && m_diags->limit_reached();
+}
+
+std::shared_ptr<Type> SemanticAnalysis::error_type() {
+  // only created if there is an error, so that an error-free
+  // analysis doesn't allocate any extra Type objects
+  if (!m_error_type)
+    m_error_type.reset(new ErrorType());
+  return m_error_type;
+}
+
 void SemanticAnalysis::enter_scope() {
   SymbolTable *scope = new SymbolTable(m_cur_symtab);
   m_cur_symtab = scope;
@@ -630,6 +962,8 @@ void SemanticAnalysis::enter_scope() {
 void SemanticAnalysis::leave_scope() {
   SymbolTable *table = m_cur_symtab;
   m_cur_symtab = m_cur_symtab->get_parent();
+  if (m_stats != nullptr)
+    m_stats->record_scope(table);
   delete(table);
   assert(m_cur_symtab != nullptr);
 }
@@ -651,45 +985,3 @@ std::string SemanticAnalysis::build_type(Node *n, std::shared_ptr<Type> &base_ty
     n = n->get_kid(0);
   }
 }
-
-bool SemanticAnalysis::comp_ptr(std::shared_ptr<Type> l, std::shared_ptr<Type> r){
-  while(l->has_base() && r->has_base()){
-    if((l->is_pointer() && !r->is_pointer()) || (!l->is_pointer() && r->is_pointer())){
-      return false;
-    }
-    if(!l->is_const() && r->is_const()){
-      return false;
-    }
-    if(!l->is_volatile() && r->is_volatile()){
-      return false;
-    }
-    l = l->get_base_type();
-    r = r->get_base_type();
-  }
-  if(!l->is_const() && r->is_const()){
-    return false;
-  }
-  if(!l->is_volatile() && r->is_volatile()){
-    return false;
-  }
-  return true;
-}
-
-bool SemanticAnalysis::is_convertible(std::shared_ptr<Type> l, std::shared_ptr<Type> r){
-  if(l->is_same(r.get())){
-    return true;
-  }
-  if(l->is_integral() && r->is_integral()){
-    return true;
-  }
-  if(l->is_array() && r->is_array() && (is_convertible(l->get_base_type(), r->get_base_type()))){
-    return true;
-  }
-  if(l->is_array() && r->is_pointer() && (is_convertible(l->get_base_type(), r->get_base_type()))){
-    return true;
-  }
-  if(l->is_pointer() && r->is_array() && (is_convertible(l->get_base_type(), r->get_base_type()))){
-    return true;
-  }
-  return false;
-}
\ No newline at end of file
@@ -2,56 +2,104 @@
 #define SEMANTIC_ANALYSIS_H
 
 #include <cstdint>
+#include <climits>
+#include <string>
 #include <memory>
 #include <utility>
+#include "location.h"
 #include "type.h"
 #include "symtab.h"
-#include "ast_visitor.h"
+#include "type_compat.h"
+#include "static_ast_visitor.h"
 #include <vector>
+class ASTStats;
+class Diagnostics;
 
-class SemanticAnalysis : public ASTVisitor {
+// Semantic analysis uses a StaticASTVisitor, so that the visit_XXX
+// calls made while traversing the AST are resolved at compile time
+class SemanticAnalysis : public StaticASTVisitor<SemanticAnalysis> {
 private:
   SymbolTable *m_global_symtab, *m_cur_symtab;
+  ASTStats *m_stats;
+  Diagnostics *m_diags;
+  std::shared_ptr<Type> m_error_type;
+  TypeCompat m_type_compat;
+  bool m_owns_global_symtab;
+  // binary expressions waiting to be checked (see visit_binary_expression)
+  std::vector<Node *> m_binary_chain;
 
 public:
   SemanticAnalysis();
-  virtual ~SemanticAnalysis();
-
-  virtual void visit_struct_type(Node *n);
-  virtual void visit_union_type(Node *n);
-  virtual void visit_variable_declaration(Node *n);
-  virtual void visit_basic_type(Node *n);
-  virtual void visit_function_definition(Node *n);
-  virtual void visit_function_declaration(Node *n);
-  virtual void visit_function_parameter(Node *n);
-  virtual void visit_statement_list(Node *n);
-  virtual void visit_struct_type_definition(Node *n);
-  virtual void visit_binary_expression(Node *n);
-  virtual void visit_unary_expression(Node *n);
-  virtual void visit_postfix_expression(Node *n);
-  virtual void visit_conditional_expression(Node *n);
-  virtual void visit_cast_expression(Node *n);
-  virtual void visit_function_call_expression(Node *n);
-  virtual void visit_field_ref_expression(Node *n);
-  virtual void visit_indirect_field_ref_expression(Node *n);
-  virtual void visit_array_element_ref_expression(Node *n);
-  virtual void visit_variable_ref(Node *n);
-  virtual void visit_literal_value(Node *n);
-  virtual void visit_return_expression_statement(Node *n);
-  // virtual void visit_return_statement(Node *n);
-  virtual void visit_while_statement(Node *n);
-  virtual void visit_do_while_statement(Node *n);
-  virtual void visit_for_statement(Node *n);
-  virtual void visit_if_statement(Node *n);
-  virtual void visit_if_else_statement(Node *n);
+  ~SemanticAnalysis();
+
+  // the global (outermost) scope; symbols imported from interface
+  // files are added here before the translation unit is analyzed
+  SymbolTable *get_global_symtab() const { return m_global_symtab; }
+
+  // if set, each scope is recorded in the given ASTStats
+  // object when it is left
+  void set_stats(ASTStats *stats) { m_stats = stats; }
+
+  // if set, errors are recorded in the given Diagnostics object,
+  // and analysis continues (until the error limit is reached);
+  // otherwise, the first error is thrown as a SemanticError
+  void set_diagnostics(Diagnostics *diags) { m_diags = diags; }
+
+  // Analyze a translation unit. If num_jobs is greater than 1, the
+  // top-level declarations are analyzed first (on this thread), and
+  // then the function bodies are analyzed in parallel on num_jobs
+  // threads. The output (symbol table entries) and the errors reported
+  // are the same as for a sequential visit of the unit.
+  void analyze_unit(Node *unit, unsigned num_jobs);
+
+  void visit_struct_type(Node *n);
+  void visit_union_type(Node *n);
+  void visit_variable_declaration(Node *n);
+  void visit_basic_type(Node *n);
+  void visit_function_definition(Node *n);
+  void visit_function_declaration(Node *n);
+  void visit_function_parameter(Node *n);
+  void visit_statement_list(Node *n);
+  void visit_struct_type_definition(Node *n);
+  void visit_binary_expression(Node *n);
+  void visit_unary_expression(Node *n);
+  void visit_postfix_expression(Node *n);
+  void visit_conditional_expression(Node *n);
+  void visit_cast_expression(Node *n);
+  void visit_function_call_expression(Node *n);
+  void visit_field_ref_expression(Node *n);
+  void visit_indirect_field_ref_expression(Node *n);
+  void visit_array_element_ref_expression(Node *n);
+  void visit_variable_ref(Node *n);
+  void visit_literal_value(Node *n);
+  void visit_return_expression_statement(Node *n);
+  // void visit_return_statement(Node *n);
+  void visit_while_statement(Node *n);
+  void visit_do_while_statement(Node *n);
+  void visit_for_statement(Node *n);
+  void visit_if_statement(Node *n);
+  void visit_if_else_statement(Node *n);
 
 private:
+  // used to analyze a function body on a worker thread,
+  // using the (read-only) global symbol table
+  SemanticAnalysis(SymbolTable *global_symtab, ASTStats *stats, Diagnostics *diags);
+
   // TODO: add helper functions
+  void error(const Location &loc, const char *fmt, ...)
+#ifdef __GNUC__
+    __attribute__ ((format (printf, 3, 4)))
+#endif
+    ;
+  bool error_limit_reached() const;
+  std::shared_ptr<Type> error_type();
+  std::shared_ptr<Type> declare_function(Node *n);
+  void check_binary_expression(Node *n);
+  void check_function_body(Node *n, const std::shared_ptr<Type> &func_type,
+                           unsigned num_globals_visible = UINT_MAX, std::string *print_buffer = nullptr);
   std::string build_type(Node *n, std::shared_ptr<Type> &base_type);
   void leave_scope();
   void enter_scope();
-  bool comp_ptr(std::shared_ptr<Type> l, std::shared_ptr<Type> r);
-  bool is_convertible(std::shared_ptr<Type> l, std::shared_ptr<Type> r);
 };
 
 #endif // SEMANTIC_ANALYSIS_H
@@ -1,5 +1,9 @@
 #include <cassert>
 #include <cstdio>
+#include <climits>
+#include "profile.h"
+#include "memstats.h"
+#include "cpputil.h"
 #include "symtab.h"
 
 ////////////////////////////////////////////////////////////////////////
@@ -12,11 +16,20 @@ Symbol::Symbol(SymbolKind kind, const std::string &name, const std::shared_ptr<T
   , m_type(type)
   , m_symtab(symtab)
   , m_is_defined(is_defined) {
+  Profile::count(PROF_SYMBOLS);
 }
 
 Symbol::~Symbol() {
 }
 
+void *Symbol::operator new(size_t size) {
+  return MemStats::allocate(size, MEM_SYMBOL);
+}
+
+void Symbol::operator delete(void *p) {
+  MemStats::deallocate(p, MEM_SYMBOL);
+}
+
 void Symbol::set_is_defined(bool is_defined) {
   m_is_defined = is_defined;
 }
@@ -29,7 +42,7 @@ const std::string &Symbol::get_name() const {
   return m_name;
 }
 
-std::shared_ptr<Type> Symbol::get_type() const {
+const std::shared_ptr<Type> &Symbol::get_type() const {
   return m_type;
 }
 
@@ -47,8 +60,12 @@ bool Symbol::is_defined() const {
 
 SymbolTable::SymbolTable(SymbolTable *parent)
   : m_parent(parent)
-  , m_has_params(false) {
+  , m_has_params(false)
+  , m_print_entries(parent == nullptr || parent->m_print_entries)
+  , m_print_buffer(parent == nullptr ? nullptr : parent->m_print_buffer)
+  , m_num_parent_symbols_visible(UINT_MAX) {
     m_fn_type = nullptr;
+  Profile::count(PROF_SCOPES);
 }
 
 SymbolTable::~SymbolTable() {
@@ -69,6 +86,22 @@ void SymbolTable::set_has_params(bool has_params) {
   m_has_params = has_params;
 }
 
+bool SymbolTable::get_print_entries() const {
+  return m_print_entries;
+}
+
+void SymbolTable::set_print_entries(bool print_entries) {
+  m_print_entries = print_entries;
+}
+
+void SymbolTable::set_print_buffer(std::string *print_buffer) {
+  m_print_buffer = print_buffer;
+}
+
+void SymbolTable::set_num_parent_symbols_visible(unsigned num_visible) {
+  m_num_parent_symbols_visible = num_visible;
+}
+
 bool SymbolTable::has_symbol_local(const std::string &name) const {
   return lookup_local(name) != nullptr;
 }
@@ -92,11 +125,13 @@ Symbol *SymbolTable::define(SymbolKind sym_kind, const std::string &name, const
 
 Symbol *SymbolTable::lookup_recursive(const std::string &name) const {
   const SymbolTable *scope = this;
+  unsigned num_visible = UINT_MAX;
 
   while (scope != nullptr) {
-    Symbol *sym = scope->lookup_local(name);
+    Symbol *sym = scope->lookup_visible(name, num_visible);
     if (sym != nullptr)
       return sym;
+    num_visible = scope->m_num_parent_symbols_visible;
     scope = scope->get_parent();
   }
 
@@ -105,11 +140,13 @@ Symbol *SymbolTable::lookup_recursive(const std::string &name) const {
 
 Symbol *SymbolTable::lookup_recursive_kind(const std::string &name, SymbolKind kind) const {
   const SymbolTable *scope = this;
+  unsigned num_visible = UINT_MAX;
 
   while (scope != nullptr) {
-    Symbol *sym = scope->lookup_local(name);
+    Symbol *sym = scope->lookup_visible(name, num_visible);
     if (sym != nullptr && sym->get_kind() == kind)
       return sym;
+    num_visible = scope->m_num_parent_symbols_visible;
     scope = scope->get_parent();
   }
 
@@ -132,6 +169,11 @@ const Type *SymbolTable::get_fn_type() const {
   return nullptr;
 }
 
+Symbol *SymbolTable::lookup_visible(const std::string &name, unsigned num_visible) const {
+  auto i = m_lookup.find(name);
+  return (i != m_lookup.end() && i->second < num_visible) ? m_symbols[i->second] : nullptr;
+}
+
 void SymbolTable::add_symbol(Symbol *sym) {
   assert(!has_symbol_local(sym->get_name()));
 
@@ -139,21 +181,28 @@ void SymbolTable::add_symbol(Symbol *sym) {
   m_symbols.push_back(sym);
   m_lookup[sym->get_name()] = pos;
 
+  if (!m_print_entries)
+    return;
+
   // Assignment 3 only: print out symbol table entries as they are added
-  printf("%d|", get_depth());
-  printf("%s|", sym->get_name().c_str());
+  const char *kind = "";
   switch (sym->get_kind()) {
   case SymbolKind::FUNCTION:
-    printf("function|"); break;
+    kind = "function"; break;
   case SymbolKind::VARIABLE:
-    printf("variable|"); break;
+    kind = "variable"; break;
   case SymbolKind::TYPE:
-    printf("type|"); break;
+    kind = "type"; break;
   default:
     assert(false);
   }
 
-  printf("%s\n", sym->get_type()->as_str().c_str());
+  std::string entry = cpputil::format("%d|%s|%s|%s\n", get_depth(), sym->get_name().c_str(),
+                                      kind, sym->get_type()->as_str().c_str());
+  if (m_print_buffer != nullptr)
+    m_print_buffer->append(entry);
+  else
+    fputs(entry.c_str(), stdout);
 }
 
 int SymbolTable::get_depth() const {
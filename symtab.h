@@ -31,6 +31,11 @@ public:
   Symbol(SymbolKind kind, const std::string &name, const std::shared_ptr<Type> &type, SymbolTable *symtab, bool is_defined);
   ~Symbol();
 
+  // allocations are attributed to the Symbol subsystem
+  // in memory reports (see memstats.h)
+  static void *operator new(size_t size);
+  static void operator delete(void *p);
+
   // a function, variable, or type can be declared
   // and then later defined, so allow m_is_defined to
   // be updated
@@ -38,7 +43,7 @@ public:
 
   SymbolKind get_kind() const;
   const std::string &get_name() const;
-  std::shared_ptr<Type> get_type() const;
+  const std::shared_ptr<Type> &get_type() const;
   SymbolTable *get_symtab() const;
   bool is_defined() const;
 };
@@ -50,6 +55,9 @@ private:
   std::map<std::string, unsigned> m_lookup;
   bool m_has_params; // true if this symbol table contains function parameters
   std::shared_ptr<Type> m_fn_type; // this is set to the type of the enclosing function (if any)
+  bool m_print_entries; // true if entries should be printed as they are added
+  std::string *m_print_buffer; // if set, printed entries are appended here rather than to stdout
+  unsigned m_num_parent_symbols_visible; // how many of the parent's symbols this scope can see
 
   // value semantics prohibited
   SymbolTable(const SymbolTable &);
@@ -61,9 +69,34 @@ public:
 
   SymbolTable *get_parent() const;
 
+  // number of symbols in this (local) scope, and the nesting
+  // depth of this scope (0 for the global scope)
+  unsigned get_num_symbols() const { return unsigned(m_symbols.size()); }
+  int get_depth() const;
+
   bool has_params() const;
   void set_has_params(bool has_params);
 
+  // Controls whether entries are printed as they are added (Assignment 3).
+  // Nested scopes inherit the setting of their parent. This is turned off
+  // while importing symbols from an interface file.
+  bool get_print_entries() const;
+  void set_print_entries(bool print_entries);
+
+  // Print entries to the given string rather than to stdout (or if
+  // null, to stdout). Nested scopes inherit the setting of their parent.
+  // This allows scopes analyzed on different threads to produce their
+  // output separately.
+  void set_print_buffer(std::string *print_buffer);
+
+  // Limit the symbols in the parent scope which are visible from this
+  // scope (and its nested scopes) to the first num_visible symbols.
+  // When function bodies are analyzed after all of the global symbols
+  // have been declared, this hides the globals declared after the
+  // function, so that the result is the same as if the function body
+  // had been analyzed immediately.
+  void set_num_parent_symbols_visible(unsigned num_visible);
+
   // Operations limited to the current (local) scope.
   // Note that the caller should verify that a name is not defined
   // in the current scope before calling declare or define.
@@ -96,8 +129,8 @@ public:
   const Type *get_fn_type() const;
 
 private:
+  Symbol *lookup_visible(const std::string &name, unsigned num_visible) const;
   void add_symbol(Symbol *sym);
-  int get_depth() const;
 };
 
 #endif // SYMTAB_H
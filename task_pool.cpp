@@ -0,0 +1,73 @@
+#include <cassert>
+#include <algorithm>
+#include <thread>
+#include "task_pool.h"
+
+TaskPool::TaskPool(unsigned num_threads)
+  : m_num_threads(num_threads < 1 ? 1 : num_threads)
+  , m_queues(m_num_threads) {
+}
+
+TaskPool::~TaskPool() {
+}
+
+void TaskPool::run(unsigned num_tasks, const std::function<void(unsigned)> &task) {
+  // no point in starting more threads than there are tasks
+  unsigned num_threads = std::min(m_num_threads, num_tasks);
+  if (num_threads <= 1) {
+    for (unsigned i = 0; i < num_tasks; ++i)
+      task(i);
+    return;
+  }
+
+  // give each thread a contiguous range of the tasks
+  for (unsigned t = 0; t < num_threads; ++t) {
+    unsigned begin = unsigned((unsigned long) num_tasks * t / num_threads);
+    unsigned end = unsigned((unsigned long) num_tasks * (t + 1) / num_threads);
+    std::lock_guard<std::mutex> guard(m_queues[t].lock);
+    assert(m_queues[t].tasks.empty());
+    for (unsigned i = begin; i < end; ++i)
+      m_queues[t].tasks.push_back(i);
+  }
+
+  // the calling thread is worker 0
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < num_threads; ++t)
+    threads.push_back(std::thread([this, t, &task]() { work(t, task); }));
+  work(0, task);
+  for (auto i = threads.begin(); i != threads.end(); ++i)
+    i->join();
+}
+
+void TaskPool::work(unsigned self, const std::function<void(unsigned)> &task) {
+  // Tasks are only added before the workers start, so once there
+  // is nothing to take or steal, there is no more work to do
+  unsigned task_num;
+  while (take(self, task_num) || steal(self, task_num))
+    task(task_num);
+}
+
+bool TaskPool::take(unsigned self, unsigned &task_num) {
+  WorkQueue &queue = m_queues[self];
+  std::lock_guard<std::mutex> guard(queue.lock);
+  if (queue.tasks.empty())
+    return false;
+  task_num = queue.tasks.front();
+  queue.tasks.pop_front();
+  return true;
+}
+
+bool TaskPool::steal(unsigned self, unsigned &task_num) {
+  // start with the next thread, so that thieves spread out
+  // rather than all robbing the same victim
+  for (unsigned n = 1; n < m_num_threads; ++n) {
+    WorkQueue &victim = m_queues[(self + n) % m_num_threads];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if (!victim.tasks.empty()) {
+      task_num = victim.tasks.back();
+      victim.tasks.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,50 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Runs a batch of independent tasks (numbered 0 to n-1) on a fixed
+// number of threads, using work stealing to balance the load. Each
+// thread starts with a contiguous range of the tasks, and takes them
+// from the front of its queue (so nearby tasks, e.g. functions that
+// are adjacent in the source, run on the same thread). A thread whose
+// queue is empty steals from the back of another thread's queue, so
+// a few large tasks don't leave the other threads idle.
+//
+// The order in which tasks run is not deterministic, so a task should
+// write its results into a slot for its task number; the caller can
+// then combine the results in order. Tasks must not throw exceptions.
+class TaskPool {
+private:
+  struct WorkQueue {
+    std::mutex lock;
+    std::deque<unsigned> tasks;
+  };
+
+  unsigned m_num_threads;
+  std::vector<WorkQueue> m_queues;
+
+  // value semantics prohibited
+  TaskPool(const TaskPool &);
+  TaskPool &operator=(const TaskPool &);
+
+public:
+  // num_threads includes the thread calling run()
+  TaskPool(unsigned num_threads);
+  ~TaskPool();
+
+  unsigned get_num_threads() const { return m_num_threads; }
+
+  // run tasks 0 to num_tasks-1, returning when all have finished
+  void run(unsigned num_tasks, const std::function<void(unsigned)> &task);
+
+private:
+  void work(unsigned self, const std::function<void(unsigned)> &task);
+  bool take(unsigned self, unsigned &task_num);
+  bool steal(unsigned self, unsigned &task_num);
+};
+
+#endif // TASK_POOL_H
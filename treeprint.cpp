@@ -19,83 +19,135 @@
 // OTHER DEALINGS IN THE SOFTWARE.
 
 #include <vector>
-#include <utility>
 #include <cstdio>
 #include <cassert>
 #include "node.h"
+#include "outbuf.h"
 #include "treeprint.h"
 
 namespace {
 
-// pair of (index, num siblings):
-// index is which sibling we're currently printing
-typedef std::pair<int, int> StackItem;
-
-struct TreePrintContext {
-  std::vector<StackItem> stack;
-  const TreePrint *tp_obj;
-
-  TreePrintContext(const TreePrint *tp_obj_)
-    : tp_obj(tp_obj_) { }
+// a node whose children are being printed
+struct StackItem {
+  Node *node;
+  unsigned next_kid;  // index of the next child to print
+};
 
-  void pushctx(int nsibs);
-  void popctx();
-  void print_node(Node *n);
+class TreePrintContext {
+private:
+  const TreePrint *m_tp_obj;
+  OutputBuffer &m_out;
+  std::vector<StackItem> m_stack;
+  // the lines drawn to the left of the children of the node
+  // on top of the stack: one 3-character segment per level
+  std::string m_indent;
+  // tag names, so that node_tag_to_string is only called
+  // once per distinct tag
+  std::vector<std::string> m_tag_names;
+
+  // value semantics prohibited
+  TreePrintContext(const TreePrintContext &);
+  TreePrintContext &operator=(const TreePrintContext &);
+
+public:
+  TreePrintContext(const TreePrint *tp_obj, OutputBuffer &out)
+    : m_tp_obj(tp_obj), m_out(out) { }
+
+  void print(Node *root, unsigned max_depth, unsigned long max_nodes);
+
+private:
+  void print_node(Node *n, bool elide_kids);
+  const std::string &get_tag_name(int tag);
 };
 
-void TreePrintContext::pushctx(int nsibs_) {
-  stack.push_back({ 0, nsibs_ });
-}
+void TreePrintContext::print(Node *root, unsigned max_depth, unsigned long max_nodes) {
+  unsigned long num_printed = 1;
+
+  // the root has no lines to its left, and since it is at depth 0,
+  // its children are always printed
+  print_node(root, false);
+  if (root->get_num_kids() > 0)
+    m_stack.push_back({ root, 0 });
+
+  while (!m_stack.empty()) {
+    StackItem &top = m_stack.back();
+    unsigned nkids = top.node->get_num_kids();
+    if (top.next_kid == nkids) {
+      m_stack.pop_back();
+      // the root's children are not indented
+      if (!m_stack.empty())
+        m_indent.resize(m_indent.size() - 3);
+      continue;
+    }
 
-void TreePrintContext::popctx() {
-  stack.pop_back();
-}
+    if (max_nodes != 0 && num_printed == max_nodes) {
+      m_out.append("...output stopped after ");
+      m_out.append_int(long(max_nodes));
+      m_out.append(" nodes\n");
+      break;
+    }
 
-void TreePrintContext::print_node(Node *n) {
-  int depth = int(stack.size());
-  assert(depth > 0);
-  for (int i = 1; i < depth; i++) {
-    if (i == depth-1) {
-      printf("+--");
-    } else {
-      int level_index = stack[i].first;
-      int level_nsibs = stack[i].second;
-      if (level_index < level_nsibs) {
-        printf("|  ");
-      } else {
-        printf("   ");
-      }
+    Node *kid = top.node->get_kid(top.next_kid++);
+    bool is_last = top.next_kid == nkids;
+    // the kid is at depth m_stack.size() (the root is at depth 0)
+    bool expand = kid->get_num_kids() > 0
+               && (max_depth == 0 || m_stack.size() < max_depth);
+
+    m_out.append(m_indent);
+    m_out.append("+--", 3);
+    print_node(kid, kid->get_num_kids() > 0 && !expand);
+    ++num_printed;
+
+    if (expand) {
+      // Note that pushing may invalidate top
+      m_indent.append(is_last ? "   " : "|  ", 3);
+      m_stack.push_back({ kid, 0 });
     }
   }
+}
 
-  int tag = n->get_tag();
-  std::string str = n->get_str();
-
-  printf("%s", tp_obj->node_tag_to_string(tag).c_str());
+void TreePrintContext::print_node(Node *n, bool elide_kids) {
+  m_out.append(get_tag_name(n->get_tag()));
+  const std::string &str = n->get_str();
   if (!str.empty()) {
-    printf("[%s]", str.c_str());
+    m_out.append('[');
+    m_out.append(str);
+    m_out.append(']');
   }
-  printf("\n");
-  stack[depth-1].first++;
+  if (elide_kids)
+    m_out.append(" ...", 4);
+  m_out.append('\n');
+}
 
-  int nkids = n->get_num_kids();
-  pushctx(nkids);
-  for (int i = 0; i < nkids; i++) {
-    print_node(n->get_kid(i));
-  }
-  popctx();
+const std::string &TreePrintContext::get_tag_name(int tag) {
+  assert(tag >= 0);
+  unsigned index = unsigned(tag);
+  if (index >= m_tag_names.size())
+    m_tag_names.resize(index + 1);
+  std::string &name = m_tag_names[index];
+  if (name.empty())
+    name = m_tp_obj->node_tag_to_string(tag);
+  return name;
 }
 
 } // end anonymous namespace
 
-TreePrint::TreePrint() {
+TreePrint::TreePrint()
+  : m_max_depth(0)
+  , m_max_nodes(0) {
 }
 
 TreePrint::~TreePrint() {
 }
 
 void TreePrint::print(Node *t) const {
-  TreePrintContext ctx(this);
-  ctx.pushctx(1);
-  ctx.print_node(t);
+  fflush(stdout);
+  OutputBuffer out(stdout);
+  print(t, out);
+  out.flush();
+}
+
+void TreePrint::print(Node *t, OutputBuffer &out) const {
+  TreePrintContext ctx(this, out);
+  ctx.print(t, m_max_depth, m_max_nodes);
 }
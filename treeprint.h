@@ -23,14 +23,34 @@
 
 #include <string>
 struct Node;
+class OutputBuffer;
 
+// Print a tree, one node per line, with lines drawn to show the
+// structure. The tree is traversed using an explicit stack, so that
+// arbitrarily deep trees can be printed, and output is written
+// through an OutputBuffer.
 class TreePrint {
+private:
+  unsigned m_max_depth;
+  unsigned long m_max_nodes;
+
 public:
   TreePrint();
   virtual ~TreePrint();
 
+  // Limit the output to nodes at most max_depth levels below the root
+  // (0 for no limit): a node whose children aren't printed is
+  // followed by "..."
+  void set_max_depth(unsigned max_depth) { m_max_depth = max_depth; }
+
+  // Stop after printing max_nodes nodes (0 for no limit)
+  void set_max_nodes(unsigned long max_nodes) { m_max_nodes = max_nodes; }
+
+  // print to stdout
   void print(Node *t) const;
 
+  void print(Node *t, OutputBuffer &out) const;
+
   virtual std::string node_tag_to_string(int tag) const = 0;
 };
 
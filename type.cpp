@@ -1,116 +1,107 @@
 #include <cassert>
 #include "exceptions.h"
+#include "profile.h"
+#include "memstats.h"
 #include "type.h"
 
 ////////////////////////////////////////////////////////////////////////
 // Type implementation
 ////////////////////////////////////////////////////////////////////////
 
-Type::Type() {
-  is_lvalue_bool = true;
+Type::Type(TypeKind kind, const std::shared_ptr<Type> &base_type)
+  : m_kind(kind)
+  , m_qualifier(TypeQualifier::NOTHING)
+  , m_basic_kind(BasicTypeKind::NOTHING)
+  , m_is_signed(false)
+  , m_is_lvalue(kind != TypeKind::FUNCTION && kind != TypeKind::ARRAY)
+  , m_has_base(kind == TypeKind::FUNCTION || kind == TypeKind::POINTER || kind == TypeKind::ARRAY)
+  , m_unqualified(this)
+  , m_base_type(base_type) {
+  Profile::count(PROF_TYPES);
+}
+
+Type::Type(BasicTypeKind basic_kind, bool is_signed)
+  : m_kind(TypeKind::BASIC)
+  , m_qualifier(TypeQualifier::NOTHING)
+  , m_basic_kind(basic_kind)
+  , m_is_signed(is_signed)
+  , m_is_lvalue(true)
+  , m_has_base(false)
+  , m_unqualified(this) {
+  Profile::count(PROF_TYPES);
+}
+
+Type::Type(const std::shared_ptr<Type> &delegate, TypeQualifier type_qualifier)
+  : m_kind(delegate->m_kind)
+  , m_qualifier(type_qualifier)
+  , m_basic_kind(delegate->m_basic_kind)
+  , m_is_signed(delegate->m_is_signed)
+  // only volatile-qualified values are treated as lvalues
+  , m_is_lvalue(type_qualifier == TypeQualifier::VOLATILE)
+  , m_has_base(true)
+  , m_unqualified(delegate->m_unqualified)
+  , m_base_type(delegate) {
+  Profile::count(PROF_TYPES);
 }
 
 Type::~Type() {
 }
 
-const Member *Type::find_member(const std::string &name) const {
-  for (unsigned i = 0; i < get_num_members(); ++i) {
-    const Member &member = get_member(i);
-    if (member.get_name() == name)
-      return &member;
-  }
-  return nullptr;
-}
-
-const Type *Type::get_unqualified_type() const {
-  // only QualifiedType will need to override this member function
-  return this;
+void *Type::operator new(size_t size) {
+  return MemStats::allocate(size, MEM_TYPE);
 }
 
-bool Type::is_basic() const {
-  return false;
+void Type::operator delete(void *p) {
+  MemStats::deallocate(p, MEM_TYPE);
 }
 
-bool Type::is_void() const {
-  return false;
-}
-
-bool Type::is_struct() const {
-  return false;
-}
-
-bool Type::is_pointer() const {
-  return false;
-}
-
-bool Type::is_array() const {
-  return false;
-}
-
-bool Type::is_function() const {
-  return false;
-}
-
-bool Type::is_volatile() const {
-  return false;
-}
-
-bool Type::is_const() const {
-  return false;
-}
-
-bool Type::has_base() const {
-  return true;
+void Type::not_a_basic_type() {
+  RuntimeError::raise("not a BasicType");
 }
 
-bool Type::is_lvalue() const {
-  return is_lvalue_bool;
+void Type::no_base_type() {
+  RuntimeError::raise("type does not have a base type");
 }
 
-BasicTypeKind Type::get_basic_type_kind() const {
-  RuntimeError::raise("not a BasicType");
+const HasMembers *Type::get_members_type() const {
+  if (m_kind != TypeKind::STRUCT && m_kind != TypeKind::FUNCTION)
+    RuntimeError::raise("type does not have members");
+  return static_cast<const HasMembers *>(m_unqualified);
 }
 
-bool Type::is_signed() const {
-  RuntimeError::raise("not a BasicType");
+const Member *Type::find_member(const std::string &name) const {
+  const std::vector<Member> &members = get_members_type()->m_members;
+  for (auto i = members.begin(); i != members.end(); ++i) {
+    if (i->get_name() == name)
+      return &*i;
+  }
+  return nullptr;
 }
 
 void Type::add_member(const Member &member) {
-  RuntimeError::raise("type does not have members");
+  // members are added to the unqualified type
+  Type *type = this;
+  while (type->m_qualifier != TypeQualifier::NOTHING)
+    type = type->m_base_type.get();
+  if (type->m_kind != TypeKind::STRUCT && type->m_kind != TypeKind::FUNCTION)
+    RuntimeError::raise("type does not have members");
+  static_cast<HasMembers *>(type)->m_members.push_back(member);
 }
 
 unsigned Type::get_num_members() const {
-  RuntimeError::raise("type does not have members");
+  return unsigned(get_members_type()->m_members.size());
 }
 
 const Member &Type::get_member(unsigned index) const {
-  RuntimeError::raise("type does not have members");
-}
-
-std::shared_ptr<Type> Type::get_base_type() const {
-  RuntimeError::raise("type does not have a base type");
+  const std::vector<Member> &members = get_members_type()->m_members;
+  assert(index < members.size());
+  return members[index];
 }
 
 unsigned Type::get_array_size() const {
-  RuntimeError::raise("not an ArrayType");
-}
-
-void Type::set_is_lvalue(bool a){
-  is_lvalue_bool = a;
-}
-////////////////////////////////////////////////////////////////////////
-// HasBaseType implementation
-////////////////////////////////////////////////////////////////////////
-
-HasBaseType::HasBaseType(const std::shared_ptr<Type> &base_type)
-  : m_base_type(base_type) {
-}
-
-HasBaseType::~HasBaseType() {
-}
-
-std::shared_ptr<Type> HasBaseType::get_base_type() const {
-  return m_base_type;
+  if (m_kind != TypeKind::ARRAY)
+    RuntimeError::raise("not an ArrayType");
+  return static_cast<const ArrayType *>(m_unqualified)->m_size;
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -129,7 +120,7 @@ const std::string &Member::get_name() const {
   return m_name;
 }
 
-std::shared_ptr<Type> Member::get_type() const {
+const std::shared_ptr<Type> &Member::get_type() const {
   return m_type;
 }
 
@@ -137,7 +128,8 @@ std::shared_ptr<Type> Member::get_type() const {
 // HasMembers implementation
 ////////////////////////////////////////////////////////////////////////
 
-HasMembers::HasMembers() {
+HasMembers::HasMembers(TypeKind kind, const std::shared_ptr<Type> &base_type)
+  : Type(kind, base_type) {
 }
 
 HasMembers::~HasMembers() {
@@ -178,26 +170,13 @@ std::string HasMembers::as_str() const {
   return s;
 }
 
-void HasMembers::add_member(const Member &member) {
-  m_members.push_back(member);
-}
-
-unsigned HasMembers::get_num_members() const {
-  return unsigned(m_members.size());
-}
-
-const Member &HasMembers::get_member(unsigned index) const {
-  assert(index < m_members.size());
-  return m_members[index];
-}
-
 ////////////////////////////////////////////////////////////////////////
 // QualifiedType implementation
 ////////////////////////////////////////////////////////////////////////
 
 QualifiedType::QualifiedType(const std::shared_ptr<Type> &delegate, TypeQualifier type_qualifier)
-  : HasBaseType(delegate)
-  , m_type_qualifier(type_qualifier) {
+  : Type(delegate, type_qualifier) {
+  assert(type_qualifier != TypeQualifier::NOTHING);
 }
 
 QualifiedType::~QualifiedType() {
@@ -222,79 +201,12 @@ std::string QualifiedType::as_str() const {
   return s;
 }
 
-const Type *QualifiedType::get_unqualified_type() const {
-  return get_base_type()->get_unqualified_type();
-}
-
-bool QualifiedType::is_basic() const {
-  return get_base_type()->is_basic();
-}
-
-bool QualifiedType::is_void() const {
-  return get_base_type()->is_void();
-}
-
-bool QualifiedType::is_struct() const {
-  return get_base_type()->is_struct();
-}
-
-bool QualifiedType::is_pointer() const {
-  return get_base_type()->is_pointer();
-}
-
-bool QualifiedType::is_array() const {
-  return get_base_type()->is_array();
-}
-
-bool QualifiedType::is_function() const {
-  return get_base_type()->is_function();
-}
-
-bool QualifiedType::is_volatile() const {
-  return m_type_qualifier == TypeQualifier::VOLATILE;
-}
-
-bool QualifiedType::is_const() const {
-  return m_type_qualifier == TypeQualifier::CONST;
-}
-
-BasicTypeKind QualifiedType::get_basic_type_kind() const {
-  return get_base_type()->get_basic_type_kind();
-}
-
-bool QualifiedType::is_signed() const {
-  return get_base_type()->is_signed();
-}
-
-bool QualifiedType::is_lvalue() const {
-  return is_volatile();
-}
-
-void QualifiedType::add_member(const Member &member) {
-  get_base_type()->add_member(member);
-}
-
-unsigned QualifiedType::get_num_members() const {
-  return get_base_type()->get_num_members();
-}
-
-const Member &QualifiedType::get_member(unsigned index) const {
-  return get_base_type()->get_member(index);
-}
-
-unsigned QualifiedType::get_array_size() const {
-  return get_base_type()->get_array_size();
-}
-
 ////////////////////////////////////////////////////////////////////////
 // BasicType implementation
 ////////////////////////////////////////////////////////////////////////
 
 BasicType::BasicType(BasicTypeKind kind, bool is_signed)
-  : m_kind(kind)
-  , m_is_signed(is_signed) {
-  is_lvalue_bool = true;
-
+  : Type(kind, is_signed) {
 }
 
 BasicType::~BasicType() {
@@ -303,8 +215,8 @@ BasicType::~BasicType() {
 bool BasicType::is_same(const Type *other) const {
   if (!other->is_basic())
     return false;
-  return m_kind == other->get_basic_type_kind()
-      && m_is_signed == other->is_signed();
+  return get_basic_type_kind() == other->get_basic_type_kind()
+      && is_signed() == other->is_signed();
 }
 
 std::string BasicType::as_str() const {
@@ -312,7 +224,7 @@ std::string BasicType::as_str() const {
 
   if (!is_signed())
     s += "unsigned ";
-  switch (m_kind) {
+  switch (get_basic_type_kind()) {
   case BasicTypeKind::CHAR:
     s += "char"; break;
   case BasicTypeKind::SHORT:
@@ -330,38 +242,13 @@ std::string BasicType::as_str() const {
   return s;
 }
 
-bool BasicType::is_basic() const {
-  return true;
-}
-
-bool BasicType::is_void() const {
-  return m_kind == BasicTypeKind::VOID;
-}
-
-BasicTypeKind BasicType::get_basic_type_kind() const {
-  return m_kind;
-}
-
-bool BasicType::is_signed() const {
-  return m_is_signed;
-}
-
-bool BasicType::has_base() const {
-  return false;
-}
-bool BasicType::is_lvalue() const{
-  return is_lvalue_bool;
-}
-void BasicType::set_is_lvalue(bool a){
-  is_lvalue_bool = a;
-}
-
 ////////////////////////////////////////////////////////////////////////
 // StructType implementation
 ////////////////////////////////////////////////////////////////////////
 
 StructType::StructType(const std::string &name)
-  : m_name(name) {
+  : HasMembers(TypeKind::STRUCT)
+  , m_name(name) {
 }
 
 StructType::~StructType() {
@@ -380,7 +267,7 @@ bool StructType::is_same(const Type *other) const {
     return false;
 
 
-  const StructType *other_st = dynamic_cast<const StructType *>(other);
+  const StructType *other_st = static_cast<const StructType *>(other->get_unqualified_type());
   if (m_name != other_st->m_name)
     return false;
 
@@ -415,19 +302,12 @@ std::string StructType::as_str() const {
   return s;
 }
 
-bool StructType::is_struct() const {
-  return true;
-}
-bool StructType::has_base() const {
-  return false;
-}
 ////////////////////////////////////////////////////////////////////////
 // FunctionType implementation
 ////////////////////////////////////////////////////////////////////////
 
 FunctionType::FunctionType(const std::shared_ptr<Type> &base_type)
-  : HasBaseType(base_type) {
-  is_lvalue_bool = false;
+  : HasMembers(TypeKind::FUNCTION, base_type) {
 }
 
 FunctionType::~FunctionType() {
@@ -465,20 +345,12 @@ std::string FunctionType::as_str() const {
   return s;
 }
 
-bool FunctionType::is_function() const {
-  return true;
-}
-
-bool FunctionType::is_lvalue() const {
-  return is_lvalue_bool;
-}
-
 ////////////////////////////////////////////////////////////////////////
 // PointerType implementation
 ////////////////////////////////////////////////////////////////////////
 
 PointerType::PointerType(const std::shared_ptr<Type> &base_type)
-  : HasBaseType(base_type) {
+  : Type(TypeKind::POINTER, base_type) {
 }
 
 PointerType::~PointerType() {
@@ -500,16 +372,12 @@ std::string PointerType::as_str() const {
   return s;
 }
 
-bool PointerType::is_pointer() const {
-  return true;
-}
-
 ////////////////////////////////////////////////////////////////////////
 // ArrayType implementation
 ////////////////////////////////////////////////////////////////////////
 
 ArrayType::ArrayType(const std::shared_ptr<Type> &base_type, unsigned size)
-  : HasBaseType(base_type)
+  : Type(TypeKind::ARRAY, base_type)
   , m_size(size) {
 }
 
@@ -525,8 +393,7 @@ bool ArrayType::is_same(const Type *other) const {
   if (!other->is_array())
     return false;
 
-  const ArrayType *other_at = dynamic_cast<const ArrayType *>(other);
-  return m_size == other_at->m_size
+  return m_size == other->get_array_size()
       && get_base_type()->is_same(other->get_base_type().get());
 }
 
@@ -541,14 +408,21 @@ std::string ArrayType::as_str() const {
   return s;
 }
 
-bool ArrayType::is_array() const {
-  return true;
+////////////////////////////////////////////////////////////////////////
+// ErrorType implementation
+////////////////////////////////////////////////////////////////////////
+
+ErrorType::ErrorType()
+  : Type(TypeKind::ERROR) {
 }
 
-unsigned ArrayType::get_array_size() const {
-  return m_size;
+ErrorType::~ErrorType() {
 }
 
-bool ArrayType::is_lvalue() const {
-  return false;
-}
\ No newline at end of file
+bool ErrorType::is_same(const Type *other) const {
+  return other->is_error();
+}
+
+std::string ErrorType::as_str() const {
+  return "<error>";
+}
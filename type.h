@@ -24,15 +24,30 @@ enum class TypeQualifier {
   NOTHING
 };
 
-// forward declaration
+// Kinds of (unqualified) types
+enum class TypeKind : unsigned char {
+  BASIC,
+  STRUCT,
+  FUNCTION,
+  POINTER,
+  ARRAY,
+  ERROR
+};
+
+// forward declarations
 class Member;
+class HasMembers;
 
 // Representation of a C data type.
-// Type is a base class that may not be directly
-// instantiated. It defines a "wide" interface of virtual member functions
-// for the complete range of functionality offered by subclasses,
-// and provides default implementations for most of them. Subclasses will
-// override these as necessary/appropriate.
+// Type is a base class that may not be directly instantiated.
+// The information needed to answer the common queries (the kind of
+// type, its qualifier, the basic type kind and signedness, and the
+// base type) is stored inline in every Type object, so that the
+// subtype and qualifier tests are non-virtual inline member functions.
+// A QualifiedType copies the kind and basic type information of its
+// delegate when it is created, so these tests are never passed on
+// to the delegate. Only the structural operations (is_same() and
+// as_str()) are virtual.
 //
 // IMPORTANT: Type objects should be accessed using std::shared_ptr.
 // Types are essentially trees, and if a variable declaration
@@ -41,27 +56,45 @@ class Member;
 // representations.
 class Type {
 private:
+  TypeKind m_kind;            // kind of the unqualified type
+  TypeQualifier m_qualifier;  // NOTHING unless this is a QualifiedType
+  BasicTypeKind m_basic_kind; // NOTHING unless the kind is BASIC
+  bool m_is_signed;
+  bool m_is_lvalue;
+  bool m_has_base;
+  const Type *m_unqualified;
+  std::shared_ptr<Type> m_base_type;
+
   // value semantics not allowed
   Type(const Type &);
   Type& operator=(const Type &);
-  bool is_lvalue_bool;
+
+  static void not_a_basic_type();
+  static void no_base_type();
+  const HasMembers *get_members_type() const;
 
 protected:
-  Type();
+  // unqualified type of the given kind, with the given base type (if any)
+  Type(TypeKind kind, const std::shared_ptr<Type> &base_type = std::shared_ptr<Type>());
+
+  // BasicType
+  Type(BasicTypeKind basic_kind, bool is_signed);
+
+  // QualifiedType
+  Type(const std::shared_ptr<Type> &delegate, TypeQualifier type_qualifier);
 
 public:
   virtual ~Type();
 
+  // allocations are attributed to the Type subsystem
+  // in memory reports (see memstats.h)
+  static void *operator new(size_t size);
+  static void operator delete(void *p);
+
   // Some member functions for convenience
-  bool is_integral() const { return is_basic() && get_basic_type_kind() != BasicTypeKind::VOID; }
+  bool is_integral() const { return is_basic() && m_basic_kind != BasicTypeKind::VOID; }
   const Member *find_member(const std::string &name) const;
 
-  // Note that Type provides default implementations of virtual
-  // member functions that will be appropriate for most of the
-  // subclasses. Each subclass should be able to just override the
-  // member functions that are necessary to provide that
-  // subclass's functionality.
-
   // equality: returns true IFF the other type represents
   // exactly the same type as this one
   virtual bool is_same(const Type *other) const = 0;
@@ -69,64 +102,62 @@ public:
   // return a string containing a description of the type
   virtual std::string as_str() const = 0;
 
+  // kind of the unqualified type
+  TypeKind get_kind() const { return m_kind; }
+
   // get unqualified type (strip off type qualifiers, if any)
-  virtual const Type *get_unqualified_type() const;
+  const Type *get_unqualified_type() const { return m_unqualified; }
 
   // subtype tests (safe to call on any Type object)
-  virtual bool is_basic() const;
-  virtual bool is_void() const;
-  virtual bool is_struct() const;
-  virtual bool is_pointer() const;
-  virtual bool is_array() const;
-  virtual bool is_function() const;
+  bool is_basic() const { return m_kind == TypeKind::BASIC; }
+  bool is_void() const { return m_basic_kind == BasicTypeKind::VOID; }
+  bool is_struct() const { return m_kind == TypeKind::STRUCT; }
+  bool is_pointer() const { return m_kind == TypeKind::POINTER; }
+  bool is_array() const { return m_kind == TypeKind::ARRAY; }
+  bool is_function() const { return m_kind == TypeKind::FUNCTION; }
+
+  // true for the type given to expressions (and declarations)
+  // found to be erroneous by semantic analysis
+  bool is_error() const { return m_kind == TypeKind::ERROR; }
 
   // qualifier tests (safe to call on any Type object)
-  virtual bool is_volatile() const;
-  virtual bool is_const() const;
+  bool is_volatile() const { return m_qualifier == TypeQualifier::VOLATILE; }
+  bool is_const() const { return m_qualifier == TypeQualifier::CONST; }
 
   // BasicType-only member functions
-  virtual BasicTypeKind get_basic_type_kind() const;
-  virtual bool is_signed() const;
+  BasicTypeKind get_basic_type_kind() const {
+    if (!is_basic())
+      not_a_basic_type();
+    return m_basic_kind;
+  }
+  bool is_signed() const {
+    if (!is_basic())
+      not_a_basic_type();
+    return m_is_signed;
+  }
 
   // Functions common to StructType and FunctionType.
   // A "member" is a parameter (for FunctionTypes) or a field (for StructTypes).
-  virtual void add_member(const Member &member);
-  virtual unsigned get_num_members() const;
-  virtual const Member &get_member(unsigned index) const;
-
-  // FunctionTypes, PointerTypes, and ArrayTypes all have
-  // a base type.
-  virtual std::shared_ptr<Type> get_base_type() const;
-
-  // FunctionType-only member functions
-  // (there aren't any, at least for now...)
-
-  // PointerType-only member functions
-  // (there actually aren't any, at least for now...)
+  void add_member(const Member &member);
+  unsigned get_num_members() const;
+  const Member &get_member(unsigned index) const;
+
+  // QualifiedTypes, FunctionTypes, PointerTypes, and ArrayTypes all
+  // have a base type. (A reference is returned, since the base type is
+  // owned by this type: the caller should make a copy of the
+  // shared_ptr if it needs the base type to outlive this type.)
+  bool has_base() const { return m_has_base; }
+  const std::shared_ptr<Type> &get_base_type() const {
+    if (!m_has_base)
+      no_base_type();
+    return m_base_type;
+  }
 
   // ArrayType-only member functions
-  virtual unsigned get_array_size() const;
-  virtual bool has_base() const;
-  virtual bool is_lvalue() const;
-  virtual void set_is_lvalue(bool a);
-  
-};
+  unsigned get_array_size() const;
 
-// Common base class for QualifiedType, FunctionType, PointerType, and
-// ArrayType
-class HasBaseType : virtual public Type {
-private:
-  std::shared_ptr<Type> m_base_type;
-
-  // value semantics are not allowed
-  HasBaseType(const HasBaseType &);
-  HasBaseType &operator=(const HasBaseType &);
-
-public:
-  HasBaseType(const std::shared_ptr<Type> &base_type);
-  virtual ~HasBaseType();
-
-  virtual std::shared_ptr<Type> get_base_type() const;
+  bool is_lvalue() const { return m_is_lvalue; }
+  void set_is_lvalue(bool a) { m_is_lvalue = a; }
 };
 
 // A parameter of a function or a field of a struct type.
@@ -142,12 +173,12 @@ public:
   ~Member();
 
   const std::string &get_name() const;
-  std::shared_ptr<Type> get_type() const;
+  const std::shared_ptr<Type> &get_type() const;
 };
 
 // Common base class for StructType and FunctionType,
 // which both have "members" (fields or parameters)
-class HasMembers : virtual public Type {
+class HasMembers : public Type {
 private:
   std::vector<Member> m_members;
 
@@ -155,23 +186,23 @@ private:
   HasMembers(const HasMembers &);
   HasMembers &operator=(const HasMembers &);
 
+  // the member functions of Type access the members
+  friend class Type;
+
+protected:
+  HasMembers(TypeKind kind, const std::shared_ptr<Type> &base_type = std::shared_ptr<Type>());
+
 public:
-  HasMembers();
   virtual ~HasMembers();
 
   virtual std::string as_str() const;
-  virtual void add_member(const Member &member);
-  virtual unsigned get_num_members() const;
-  virtual const Member &get_member(unsigned index) const;
 };
 
-// A QualifiedType modifies a "delegate" type with a TypeQualifier
-// (const or volatile). Most of the member functions a just passed
-// on to the delegate.
-class QualifiedType : public HasBaseType {
+// A QualifiedType modifies a "delegate" type (its base type) with a
+// TypeQualifier (const or volatile). Its kind and basic type information
+// are those of the delegate.
+class QualifiedType : public Type {
 private:
-  TypeQualifier m_type_qualifier;
-
   // value semantics are not allowed
   QualifiedType(const QualifiedType &);
   QualifiedType &operator=(const QualifiedType &);
@@ -182,29 +213,10 @@ public:
 
   virtual bool is_same(const Type *other) const;
   virtual std::string as_str() const;
-  virtual const Type *get_unqualified_type() const;
-  virtual bool is_basic() const;
-  virtual bool is_void() const;
-  virtual bool is_struct() const;
-  virtual bool is_pointer() const;
-  virtual bool is_array() const;
-  virtual bool is_function() const;
-  virtual bool is_volatile() const;
-  virtual bool is_const() const;
-  virtual BasicTypeKind get_basic_type_kind() const;
-  virtual bool is_signed() const;
-  virtual void add_member(const Member &member);
-  virtual unsigned get_num_members() const;
-  virtual const Member &get_member(unsigned index) const;
-  virtual unsigned get_array_size() const;
-  virtual bool is_lvalue() const;
 };
 
 class BasicType : public Type {
 private:
-  BasicTypeKind m_kind;
-  bool m_is_signed;
-  bool is_lvalue_bool;
   // value semantics not allowed
   BasicType(const BasicType &);
   BasicType &operator=(const BasicType &);
@@ -215,13 +227,6 @@ public:
 
   virtual bool is_same(const Type *other) const;
   virtual std::string as_str() const;
-  virtual bool is_basic() const;
-  virtual bool is_void() const;
-  virtual BasicTypeKind get_basic_type_kind() const;
-  virtual bool is_signed() const;
-  virtual bool has_base() const;
-  virtual bool is_lvalue() const;
-  virtual void set_is_lvalue(bool);
 };
 
 class StructType : public HasMembers {
@@ -240,27 +245,23 @@ public:
 
   virtual bool is_same(const Type *other) const;
   virtual std::string as_str() const;
-  virtual bool is_struct() const;
-  virtual bool has_base() const;
 };
 
-class FunctionType : public HasBaseType, public HasMembers {
+class FunctionType : public HasMembers {
 private:
   // value semantics not allowed
   FunctionType(const FunctionType &);
   FunctionType &operator=(const FunctionType &);
-  bool is_lvalue_bool;
+
 public:
   FunctionType(const std::shared_ptr<Type> &base_type);
   virtual ~FunctionType();
 
   virtual bool is_same(const Type *other) const;
   virtual std::string as_str() const;
-  virtual bool is_function() const;
-  virtual bool is_lvalue() const;
 };
 
-class PointerType : public HasBaseType {
+class PointerType : public Type {
 private:
   // value semantics not allowed
   PointerType(const PointerType &);
@@ -271,10 +272,9 @@ public:
 
   virtual bool is_same(const Type *other) const;
   virtual std::string as_str() const;
-  virtual bool is_pointer() const;
 };
 
-class ArrayType : public HasBaseType {
+class ArrayType : public Type {
 private:
   unsigned m_size;
 
@@ -282,15 +282,33 @@ private:
   ArrayType(const ArrayType &);
   ArrayType &operator=(const ArrayType &);
 
+  // Type::get_array_size() accesses the size
+  friend class Type;
+
 public:
   ArrayType(const std::shared_ptr<Type> &base_type, unsigned size);
   virtual ~ArrayType();
 
   virtual bool is_same(const Type *other) const;
   virtual std::string as_str() const;
-  virtual bool is_array() const;
-  virtual unsigned get_array_size() const;
-  virtual bool is_lvalue() const;
+};
+
+// The type of an erroneous expression or declaration. Semantic
+// analysis gives this type to a node when it reports an error, and
+// doesn't report further errors about nodes of this type, so that
+// one mistake doesn't produce a cascade of error messages.
+class ErrorType : public Type {
+private:
+  // value semantics not allowed
+  ErrorType(const ErrorType &);
+  ErrorType &operator=(const ErrorType &);
+
+public:
+  ErrorType();
+  virtual ~ErrorType();
+
+  virtual bool is_same(const Type *other) const;
+  virtual std::string as_str() const;
 };
 
 #endif // TYPE_H
@@ -0,0 +1,117 @@
+#include "type_compat.h"
+
+namespace {
+
+const unsigned NUM_BASIC_KINDS = unsigned(BasicTypeKind::NOTHING) + 1;
+const unsigned NUM_BASIC_TYPES = NUM_BASIC_KINDS * 2;
+
+// index of an (unqualified) BasicType in the conversion matrix
+inline unsigned basic_index(const Type *type) {
+  return unsigned(type->get_basic_type_kind()) * 2 + (type->is_signed() ? 1 : 0);
+}
+
+struct BasicConversions {
+  Conversion matrix[NUM_BASIC_TYPES][NUM_BASIC_TYPES];
+
+  BasicConversions() {
+    for (unsigned to = 0; to < NUM_BASIC_TYPES; ++to) {
+      for (unsigned from = 0; from < NUM_BASIC_TYPES; ++from) {
+        bool to_void = to / 2 == unsigned(BasicTypeKind::VOID);
+        bool from_void = from / 2 == unsigned(BasicTypeKind::VOID);
+        if (to == from)
+          matrix[to][from] = Conversion::IDENTITY;
+        else if (!to_void && !from_void)
+          matrix[to][from] = Conversion::INTEGRAL;
+        else
+          matrix[to][from] = Conversion::NONE;
+      }
+    }
+  }
+};
+
+const BasicConversions s_basic_conversions;
+
+// true for a BasicType without qualifiers
+inline bool is_plain_basic(const Type *type) {
+  return type->is_basic() && !type->has_base();
+}
+
+}
+
+TypeCompat::TypeCompat() {
+}
+
+TypeCompat::~TypeCompat() {
+}
+
+Conversion TypeCompat::convert(const std::shared_ptr<Type> &to, const std::shared_ptr<Type> &from) {
+  // basic types (the common case) don't need the cache
+  if (is_plain_basic(to.get()) && is_plain_basic(from.get()))
+    return convert_basic(to.get(), from.get());
+  return lookup(m_convert_cache, to, from, compute_convert);
+}
+
+Conversion TypeCompat::convert_pointer(const std::shared_ptr<Type> &to, const std::shared_ptr<Type> &from) {
+  return lookup(m_pointer_cache, to, from, compute_pointer);
+}
+
+void TypeCompat::clear() {
+  m_convert_cache.clear();
+  m_pointer_cache.clear();
+}
+
+Conversion TypeCompat::lookup(Cache &cache, const std::shared_ptr<Type> &to, const std::shared_ptr<Type> &from,
+                              Conversion (*compute)(const Type *, const Type *)) {
+  Key key(to.get(), from.get());
+  auto i = cache.find(key);
+  if (i != cache.end())
+    return i->second.conv;
+
+  Entry entry;
+  entry.conv = compute(to.get(), from.get());
+  entry.to = to;
+  entry.from = from;
+  cache.insert(std::make_pair(key, entry));
+  return entry.conv;
+}
+
+Conversion TypeCompat::convert_basic(const Type *to, const Type *from) {
+  return s_basic_conversions.matrix[basic_index(to)][basic_index(from)];
+}
+
+Conversion TypeCompat::compute_convert(const Type *to, const Type *from) {
+  if (to->is_same(from))
+    return Conversion::IDENTITY;
+  if (to->is_integral() && from->is_integral())
+    return Conversion::INTEGRAL;
+
+  // arrays and pointers are compatible if their element types are
+  if ((to->is_array() && (from->is_array() || from->is_pointer()))
+      || (to->is_pointer() && from->is_array())) {
+    if (compute_convert(to->get_base_type().get(), from->get_base_type().get()) != Conversion::NONE)
+      return Conversion::ARRAY_DECAY;
+  }
+
+  return Conversion::NONE;
+}
+
+Conversion TypeCompat::compute_pointer(const Type *to, const Type *from) {
+  if (to == from)
+    return Conversion::IDENTITY;
+
+  // The pointers must have the same number of levels of indirection,
+  // and at each level, "to" must have the qualifiers of "from".
+  // Raw pointers can be used, since the base types are owned
+  // by the types that refer to them.
+  while (to->has_base() && from->has_base()) {
+    if (to->is_pointer() != from->is_pointer())
+      return Conversion::NONE;
+    if ((!to->is_const() && from->is_const()) || (!to->is_volatile() && from->is_volatile()))
+      return Conversion::NONE;
+    to = to->get_base_type().get();
+    from = from->get_base_type().get();
+  }
+  if ((!to->is_const() && from->is_const()) || (!to->is_volatile() && from->is_volatile()))
+    return Conversion::NONE;
+  return Conversion::POINTER_QUALIFICATION;
+}
@@ -0,0 +1,74 @@
+#ifndef TYPE_COMPAT_H
+#define TYPE_COMPAT_H
+
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include "type.h"
+
+// How a value of one type is converted to another type
+// (e.g., in an assignment, argument, or return value)
+enum class Conversion {
+  NONE,                   // the types aren't compatible
+  IDENTITY,               // the types are the same
+  INTEGRAL,               // between integral types (promotion or truncation)
+  POINTER_QUALIFICATION,  // between pointers, adding qualifiers
+  ARRAY_DECAY,            // between an array and a pointer (or array)
+                          // with compatible element types
+};
+
+// Type compatibility checks for semantic analysis. Conversions between
+// basic types are looked up in a precomputed matrix, and the results
+// for other (derived) types are cached by the pair of Type objects.
+// The cache holds references to the Types it has seen, so call clear()
+// when they are no longer needed (e.g., at the end of a function).
+// A TypeCompat object must only be used by one thread at a time.
+class TypeCompat {
+private:
+  typedef std::pair<const Type *, const Type *> Key;
+
+  struct KeyHash {
+    size_t operator()(const Key &key) const {
+      return std::hash<const Type *>()(key.first) * 31 + std::hash<const Type *>()(key.second);
+    }
+  };
+
+  struct Entry {
+    Conversion conv;
+    std::shared_ptr<Type> to, from;  // keep the Types alive, so their addresses can't be reused
+  };
+
+  typedef std::unordered_map<Key, Entry, KeyHash> Cache;
+
+  Cache m_convert_cache, m_pointer_cache;
+
+  // value semantics prohibited
+  TypeCompat(const TypeCompat &);
+  TypeCompat &operator=(const TypeCompat &);
+
+public:
+  TypeCompat();
+  ~TypeCompat();
+
+  // how a value of type "from" is converted to type "to" (either
+  // can be the type of an argument, variable, or return value: the
+  // check is symmetric)
+  Conversion convert(const std::shared_ptr<Type> &to, const std::shared_ptr<Type> &from);
+
+  // how a pointer of type "from" is converted to the pointer type
+  // "to": at each level, "to" must have at least the qualifiers
+  // of "from"
+  Conversion convert_pointer(const std::shared_ptr<Type> &to, const std::shared_ptr<Type> &from);
+
+  // forget the cached results
+  void clear();
+
+private:
+  Conversion lookup(Cache &cache, const std::shared_ptr<Type> &to, const std::shared_ptr<Type> &from,
+                    Conversion (*compute)(const Type *, const Type *));
+  static Conversion compute_convert(const Type *to, const Type *from);
+  static Conversion compute_pointer(const Type *to, const Type *from);
+  static Conversion convert_basic(const Type *to, const Type *from);
+};
+
+#endif // TYPE_COMPAT_H